@@ -19,6 +19,13 @@ cd ${ENVPOOL_NAME}
 
 # apply patches
 git apply ../patches/envpool.patch
+# register the dependencies of gobang_mcts, e.g., google benchmark
+cat >> WORKSPACE << EOF
+
+load("//envpool/${ENV_NAME}:workspace.bzl", ${ENV_NAME}_workspace = "workspace")
+
+${ENV_NAME}_workspace()
+EOF
 
 # build all
 make bazel-clean
@@ -71,6 +71,7 @@ class GobangTest(unittest.TestCase):
                 actions = {
                     "prior_probs": 0.1 * np.ones((num_envs, 15 * 15), dtype=np.float32),
                     "value": 0.1 * np.ones((num_envs, ), dtype=np.float32),
+                    "model_version": np.zeros(num_envs, dtype=np.int32),
                     "selected_action": selected_action,
                 }
                 env.send(actions, env_id)
@@ -171,6 +172,7 @@ class GobangTest(unittest.TestCase):
                 actions = {
                     "prior_probs": 0.1 * np.ones((batch_size, 15 * 15), dtype=np.float32),
                     "value": 0.1 * np.ones((batch_size, ), dtype=np.float32),
+                    "model_version": np.zeros(batch_size, dtype=np.int32),
                     "selected_action": selected_action[env_id]
                 }
                 env.send(actions, env_id)
@@ -214,6 +216,380 @@ class GobangTest(unittest.TestCase):
                         and np.sum(res[k + num_player_planes]) <= 1
                     )
 
+    def testBatchedLeaves(self):
+        num_envs = 4
+        num_threads = 2
+        num_player_planes = 2
+        num_search = 100
+        leaves_per_step = 8
+        env = envpool.make_gym(
+            "GobangSelfPlay", num_envs=num_envs,
+            num_threads=num_threads, num_player_planes=num_player_planes,
+            num_search=num_search, leaves_per_step=leaves_per_step,
+        )
+        done = [False for _ in range(num_envs)]
+        selected_action = np.zeros((num_envs, ), dtype=np.int32)
+
+        env.async_reset()
+        while not all(done):
+            obs, reward, terminated, truncated, info = env.recv()
+            self.assertEqual(
+                obs.state.shape,
+                (num_envs, leaves_per_step, num_player_planes * 2 + 1, 15, 15))
+            num_leaves = info["num_leaves"]
+            self.assertTrue(np.all(num_leaves <= leaves_per_step))
+            for i in range(num_envs):
+                # padded leaves are all zeros
+                self.assertTrue(np.all(obs.state[i][num_leaves[i]:] == 0))
+                if info["is_player_done"][i]:
+                    self.assertEqual(num_leaves[i], 0)
+                    mcts_result = obs.mcts_result[i]
+                    selected_action[i] = np.argmax(mcts_result)
+                done[i] = done[i] or terminated[i]
+
+            actions = {
+                "prior_probs": 0.1 * np.ones((num_envs, leaves_per_step, 15 * 15), dtype=np.float32),
+                "value": 0.1 * np.ones((num_envs, leaves_per_step), dtype=np.float32),
+                "model_version": np.zeros(num_envs, dtype=np.int32),
+                "selected_action": selected_action,
+            }
+            env.send(actions, info["env_id"])
+
+    def testEvalCache(self):
+        num_envs = 8
+        num_search = 100
+        env = envpool.make_gym(
+            "GobangSelfPlay", num_envs=num_envs, num_threads=2,
+            num_search=num_search, eval_cache_size=100000,
+        )
+        actions = {
+            "prior_probs": 0.1 * np.ones((num_envs, 15 * 15), dtype=np.float32),
+            "value": 0.1 * np.ones((num_envs, ), dtype=np.float32),
+            "model_version": np.zeros(num_envs, dtype=np.int32),
+        }
+        env.async_reset()
+        for _ in range(num_search * 4):
+            obs, reward, terminated, truncated, info = env.recv()
+            actions["selected_action"] = np.argmax(
+                obs["mcts_result"], axis=1).astype(np.int32)
+            env.send(actions, info["env_id"])
+        # all envs search the same opening with the same priors
+        self.assertGreater(np.sum(info["cache_hits"]), 0)
+
+    def testStateFormat(self):
+        from envpool.gobang_mcts import unpack_state
+        num_envs = 2
+        num_search = 50
+        num_player_planes = 2
+        envs = {
+            state_format: envpool.make_gym(
+                "GobangSelfPlay", num_envs=num_envs, num_threads=1,
+                num_search=num_search, num_player_planes=num_player_planes,
+                state_format=state_format,
+            )
+            for state_format in ["int32", "uint8", "bits"]
+        }
+        self.assertEqual(
+            envs["bits"].observation_space["state_compact"].shape,
+            (num_player_planes * 2 + 1, 4 * 8))
+        actions = {
+            "prior_probs": 0.1 * np.ones((num_envs, 15 * 15), dtype=np.float32),
+            "value": 0.1 * np.ones((num_envs, ), dtype=np.float32),
+            "model_version": np.zeros(num_envs, dtype=np.int32),
+        }
+        obs = {name: env.reset()[0] for name, env in envs.items()}
+        for _ in range(num_search * 3):
+            state = obs["int32"].state
+            for state_format in ["uint8", "bits"]:
+                unpacked = unpack_state(
+                    obs[state_format].state_compact, 15, state_format)
+                np.testing.assert_array_equal(unpacked, state)
+            actions["selected_action"] = np.argmax(
+                obs["int32"].mcts_result, axis=1).astype(np.int32)
+            obs = {name: env.step(actions)[0] for name, env in envs.items()}
+
+    def testAugmentation(self):
+        num_envs = 2
+        num_search = 50
+        num_player_planes = 2
+        for num_augmentations in [8, 3]:
+            env = envpool.make_gym(
+                "GobangSelfPlay", num_envs=num_envs, num_threads=1,
+                num_search=num_search, num_player_planes=num_player_planes,
+                num_augmentations=num_augmentations,
+            )
+            actions = {
+                "prior_probs": 0.1 * np.ones((num_envs, 15 * 15), dtype=np.float32),
+                "value": 0.1 * np.ones((num_envs, ), dtype=np.float32),
+                "model_version": np.zeros(num_envs, dtype=np.int32),
+            }
+            obs, info = env.reset()
+            num_checked = 0
+            for _ in range(num_search * 4):
+                for i in range(num_envs):
+                    if not info["is_player_done"][i]:
+                        continue
+                    symmetries = info["symmetries"][i]
+                    self.assertEqual(len(set(symmetries)), num_augmentations)
+                    state = obs.state[i]
+                    mcts_result = obs.mcts_result[i].reshape(15, 15)
+                    for k, s in enumerate(symmetries):
+                        # flip the columns, then rotate clockwise
+                        expected_state = np.flip(state, -1) if s & 4 else state
+                        expected_state = np.rot90(expected_state, k=-(s & 3), axes=(-2, -1))
+                        np.testing.assert_array_equal(
+                            obs.augmented_state[i][k], expected_state)
+                        expected_result = np.flip(mcts_result, -1) if s & 4 else mcts_result
+                        expected_result = np.rot90(expected_result, k=-(s & 3))
+                        np.testing.assert_array_equal(
+                            obs.augmented_mcts_result[i][k], expected_result.reshape(-1))
+                    num_checked += 1
+                actions["selected_action"] = np.argmax(
+                    obs.mcts_result, axis=1).astype(np.int32)
+                obs, reward, terminated, truncated, info = env.step(actions)
+            self.assertGreater(num_checked, 0)
+
+    def testRolloutEvaluator(self):
+        num_envs = 4
+        env = envpool.make_gym(
+            "GobangSelfPlay", num_envs=num_envs, num_threads=2,
+            board_size=9, num_search=100, evaluator="heuristic",
+        )
+        # NOTE: prior_probs & value are ignored by the built-in evaluator
+        actions = {
+            "prior_probs": np.zeros((num_envs, 9 * 9), dtype=np.float32),
+            "value": np.zeros((num_envs, ), dtype=np.float32),
+            "model_version": np.zeros(num_envs, dtype=np.int32),
+        }
+        done = np.zeros(num_envs, dtype=bool)
+        obs, info = env.reset()
+        while not np.all(done):
+            # every step finishes a move
+            self.assertTrue(np.all(info["is_player_done"] | done))
+            self.assertTrue(np.all(info["num_leaves"] == 0))
+            actions["selected_action"] = np.argmax(
+                obs.mcts_result, axis=1).astype(np.int32)
+            obs, reward, terminated, truncated, info = env.step(actions)
+            done |= terminated
+
+    def testSampleMoves(self):
+        num_envs, board_size = 4, 7
+        env = envpool.make_gym(
+            "GobangSelfPlay", num_envs=num_envs, num_threads=2,
+            board_size=board_size, win_length=4, num_search=50,
+            sample_moves=True, temperature_moves=4, dirichlet_alpha=0.3,
+        )
+        # NOTE: selected_action is ignored, moves are sampled in C++
+        actions = {
+            "prior_probs": np.ones((num_envs, board_size * board_size), dtype=np.float32) / board_size ** 2,
+            "value": np.zeros((num_envs, ), dtype=np.float32),
+            "selected_action": -np.ones(num_envs, dtype=np.int32),
+            "model_version": np.zeros(num_envs, dtype=np.int32),
+        }
+        done = np.zeros(num_envs, dtype=bool)
+        num_moves = np.zeros(num_envs, dtype=np.int32)
+        obs, info = env.reset()
+        while not np.all(done):
+            obs, reward, terminated, truncated, info = env.step(actions)
+            for i in np.where(~done & (info["sampled_action"] >= 0))[0]:
+                action = info["sampled_action"][i]
+                self.assertGreater(obs.mcts_result[i][action], 0)
+                # the training state is taken before the move
+                self.assertEqual(obs.sampled_state[i][0].reshape(-1)[action], 0)
+                num_moves[i] += 1
+            self.assertTrue(np.all(info["player_step_count"][~done] == num_moves[~done]))
+            done |= terminated
+
+    def testTrajectory(self):
+        from envpool.gobang_mcts import drain_trajectories, unpack_state
+        num_envs, board_size = 4, 7
+        env = envpool.make_gym(
+            "GobangSelfPlay", num_envs=num_envs, num_threads=2,
+            board_size=board_size, win_length=4, num_search=50, num_player_planes=2,
+            evaluator="heuristic", sample_moves=True, emit_trajectory=True,
+        )
+        actions = {
+            "prior_probs": np.zeros((num_envs, board_size * board_size), dtype=np.float32),
+            "value": np.zeros((num_envs, ), dtype=np.float32),
+            "selected_action": -np.ones(num_envs, dtype=np.int32),
+            "model_version": np.zeros(num_envs, dtype=np.int32),
+        }
+        drain_trajectories()
+        done = np.zeros(num_envs, dtype=bool)
+        lengths, winners = {}, {}
+        env.reset()
+        while not np.all(done):
+            obs, reward, terminated, truncated, info = env.step(actions)
+            # the trajectory is not part of the per-step state
+            self.assertFalse(hasattr(obs, "trajectory_state"))
+            for i in np.where(~done & terminated)[0]:
+                lengths[info["env_id"][i]] = info["trajectory_length"][i]
+                winners[info["env_id"][i]] = info["winner"][i]
+                self.assertEqual(info["trajectory_length"][i], info["player_step_count"][i])
+            done |= terminated
+
+        # NOTE: reset envs may finish another episode, only check the first one of each env
+        episodes = {}
+        for episode in drain_trajectories():
+            episodes.setdefault(episode["env_id"], episode)
+        self.assertEqual(sorted(episodes), sorted(lengths))
+        # other pools have their own queues
+        self.assertEqual(drain_trajectories(pool="other"), [])
+        for env_id, episode in episodes.items():
+            length = lengths[env_id]
+            self.assertEqual(episode["winner"], winners[env_id])
+            np.testing.assert_array_equal(episode["player"], np.arange(length) % 2)
+            self.assertEqual(len(episode["visit_offsets"]), length + 1)
+            states = unpack_state(episode["state"], board_size)
+            for k, action in enumerate(episode["action"]):
+                begin, end = episode["visit_offsets"][k], episode["visit_offsets"][k + 1]
+                visits = dict(zip(episode["visit_actions"][begin:end],
+                                  episode["visit_counts"][begin:end]))
+                self.assertGreater(visits[action], 0)
+                # stones of both players, before the move
+                self.assertEqual(states[k][0].sum() + states[k][2].sum(), k)
+
+    def testReplay(self):
+        import tempfile
+        from envpool.gobang_mcts import ReplayReader
+        num_envs, board_size = 4, 7
+        prefix = tempfile.mkdtemp() + "/games"
+        env = envpool.make_gym(
+            "GobangSelfPlay", num_envs=num_envs, num_threads=2,
+            board_size=board_size, win_length=4, num_search=50, num_player_planes=2,
+            evaluator="heuristic", sample_moves=True,
+            replay_path=prefix, replay_shard_size=16,
+        )
+        actions = {
+            "prior_probs": np.zeros((num_envs, board_size * board_size), dtype=np.float32),
+            "value": np.zeros((num_envs, ), dtype=np.float32),
+            "selected_action": -np.ones(num_envs, dtype=np.int32),
+            "model_version": np.zeros(num_envs, dtype=np.int32),
+        }
+        done = np.zeros(num_envs, dtype=bool)
+        num_moves = 0
+        env.reset()
+        while not np.all(done):
+            obs, reward, terminated, truncated, info = env.step(actions)
+            num_moves += np.sum(info["player_step_count"][terminated & ~done])
+            done |= terminated
+
+        reader = ReplayReader(prefix)
+        self.assertEqual(len(reader), num_moves)
+        batch = reader.sample(32)
+        states, visits, values = reader.decode(batch)
+        self.assertEqual(states.shape, (32, 5, board_size, board_size))
+        self.assertTrue(np.all(visits.sum(axis=1) > 0))
+        self.assertTrue(np.all(np.abs(values) <= 1))
+        # the last plane is filled with the player to move
+        np.testing.assert_array_equal(states[:, -1, 0, 0], batch["player"])
+
+    def testPlayoutCap(self):
+        num_envs, board_size = 4, 7
+        env = envpool.make_gym(
+            "GobangSelfPlay", num_envs=num_envs, num_threads=2,
+            board_size=board_size, win_length=4, num_search=200,
+            evaluator="heuristic", full_search_prob=0.25, num_search_fast=20,
+        )
+        actions = {
+            "prior_probs": np.zeros((num_envs, board_size * board_size), dtype=np.float32),
+            "value": np.zeros((num_envs, ), dtype=np.float32),
+            "model_version": np.zeros(num_envs, dtype=np.int32),
+        }
+        done = np.zeros(num_envs, dtype=bool)
+        num_full, num_fast = 0, 0
+        obs, info = env.reset()
+        while not np.all(done):
+            moved = ~done & info["is_player_done"]
+            num_visits = np.maximum(obs.mcts_result, 0).sum(axis=1)
+            full = moved & info["is_full_search"]
+            self.assertTrue(np.all(num_visits[full] >= 199))
+            num_full += full.sum()
+            num_fast += (moved & ~info["is_full_search"]).sum()
+            actions["selected_action"] = np.argmax(
+                obs.mcts_result, axis=1).astype(np.int32)
+            obs, reward, terminated, truncated, info = env.step(actions)
+            done |= terminated
+        self.assertGreater(num_full, 0)
+        self.assertGreater(num_fast, num_full)
+
+    def testEarlyStop(self):
+        num_envs, board_size = 4, 7
+        env = envpool.make_gym(
+            "GobangSelfPlay", num_envs=num_envs, num_threads=2,
+            board_size=board_size, win_length=4, num_search=400,
+            evaluator="heuristic", early_stop=True,
+        )
+        actions = {
+            "prior_probs": np.zeros((num_envs, board_size * board_size), dtype=np.float32),
+            "value": np.zeros((num_envs, ), dtype=np.float32),
+            "model_version": np.zeros(num_envs, dtype=np.int32),
+        }
+        done = np.zeros(num_envs, dtype=bool)
+        num_pruned = 0
+        obs, info = env.reset()
+        while not np.all(done):
+            moved = ~done & info["is_player_done"]
+            self.assertTrue(np.all(info["pruned_simulations"][moved] < 400))
+            num_pruned += info["pruned_simulations"][moved].sum()
+            actions["selected_action"] = np.argmax(
+                obs.mcts_result, axis=1).astype(np.int32)
+            obs, reward, terminated, truncated, info = env.step(actions)
+            done |= terminated
+        self.assertGreater(num_pruned, 0)
+
+    def testInstrumentation(self):
+        num_envs = 2
+        env = envpool.make_gym(
+            "GobangSelfPlay", num_envs=num_envs, num_threads=1,
+            board_size=9, num_search=50, leaves_per_step=4, instrumentation=True,
+        )
+        actions = {
+            "prior_probs": np.ones((num_envs, 4, 9 * 9), dtype=np.float32) / 81,
+            "value": np.zeros((num_envs, 4), dtype=np.float32),
+            "selected_action": np.zeros(num_envs, dtype=np.int32),
+            "model_version": np.zeros(num_envs, dtype=np.int32),
+        }
+        obs, info = env.reset()
+        self.assertEqual(info["search_counters"].shape, (num_envs, 6))
+        self.assertEqual(info["phase_ns"].shape, (num_envs, 7))
+        counters = info["search_counters"]
+        for _ in range(100):
+            actions["selected_action"] = np.argmax(
+                obs.mcts_result, axis=1).astype(np.int32)
+            obs, reward, terminated, truncated, info = env.step(actions)
+            if np.any(terminated):
+                break
+            # cumulative over the episode
+            self.assertTrue(np.all(info["search_counters"] >= counters))
+            counters = info["search_counters"]
+        self.assertTrue(np.all(counters[:, 0] > 0))
+        self.assertTrue(np.all(info["phase_ns"] >= 0))
+
+    def testBoardSizes(self):
+        # NOTE: compile-time boards (9, 11, 19) and the dynamic board (7, 10)
+        num_envs = 2
+        for board_size in [7, 9, 10, 11, 19]:
+            env = envpool.make_gym(
+                "GobangSelfPlay", num_envs=num_envs, num_threads=2,
+                board_size=board_size, num_search=20, evaluator="heuristic",
+            )
+            actions = {
+                "prior_probs": np.zeros((num_envs, board_size * board_size), dtype=np.float32),
+                "value": np.zeros((num_envs, ), dtype=np.float32),
+                "model_version": np.zeros(num_envs, dtype=np.int32),
+            }
+            done = np.zeros(num_envs, dtype=bool)
+            obs, info = env.reset()
+            self.assertEqual(obs.state.shape[-1], board_size)
+            while not np.all(done):
+                self.assertTrue(np.all(obs.mcts_result[~done].max(axis=1) > 0))
+                actions["selected_action"] = np.argmax(
+                    obs.mcts_result, axis=1).astype(np.int32)
+                obs, reward, terminated, truncated, info = env.step(actions)
+                done |= terminated
+            self.assertTrue(np.all(info["player_step_count"] <= board_size * board_size))
+
     @unittest.skip("Too slow")
     def testDelay(self):
         num_envs = 250
@@ -268,6 +644,7 @@ class GobangTest(unittest.TestCase):
                 actions = {
                     "prior_probs": 0.1 * np.ones((batch_size, 15 * 15), dtype=np.float32),
                     "value": 0.1 * np.ones((batch_size, ), dtype=np.float32),
+                    "model_version": np.zeros(batch_size, dtype=np.int32),
                     "selected_action": selected_action[env_id]
                 }
                 env.send(actions, env_id)
@@ -325,6 +702,7 @@ class GobangTest(unittest.TestCase):
         actions = {
             "prior_probs": 0.1 * np.ones((batch_size, 15 * 15), dtype=np.float32),
             "value": 0.1 * np.ones((batch_size, ), dtype=np.float32),
+            "model_version": np.zeros(batch_size, dtype=np.int32),
         }
         n_steps = 5000
         env.async_reset()
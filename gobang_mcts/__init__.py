@@ -1,6 +1,10 @@
 from envpool.python.api import py_env
 
-from .py_gobang_envpool import _GobangEnvSpec, _GobangEnvPool
+from .py_gobang_envpool import (
+    _GobangEnvSpec, _GobangEnvPool, drain_trajectories, num_dropped_trajectories
+)
+from .replay_utils import ReplayReader
+from .state_utils import pack_state, unpack_state
 
 GobangEnvSpec, GobangDMEnvPool, \
     GobangGymEnvPool, GobangGymnasiumEnvPool = py_env(
@@ -12,4 +16,9 @@ __all__ = [
     "GobangDMEnvPool",
     "GobangGymEnvPool",
     "GobangGymnasiumEnvPool",
+    "ReplayReader",
+    "drain_trajectories",
+    "num_dropped_trajectories",
+    "pack_state",
+    "unpack_state",
 ]
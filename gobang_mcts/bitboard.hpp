@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#if !defined(GOBANG_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define GOBANG_BITBOARD_AVX2
+#elif !defined(GOBANG_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define GOBANG_BITBOARD_SSE2
+#endif
+
+#include "envpool/gobang_mcts/utils.hpp"
+
+struct BitBoard
+{
+    // NOTE: one bit plane per player
+    //  bit j of rows[i] is set iff cell (i, j) is occupied.
+    //  Boards are limited to 32 columns so that a row fits in a uint32_t.
+    static const int MAX_BOARD_SIZE = 32;
+
+    std::array<uint32_t, MAX_BOARD_SIZE> rows;
+
+    BitBoard() : rows{} {}
+
+    bool test(int row, int col) const
+    {
+        return (rows[row] >> col) & 1u;
+    }
+
+    void set(int row, int col)
+    {
+        rows[row] |= 1u << col;
+    }
+
+    void reset(int row, int col)
+    {
+        rows[row] &= ~(1u << col);
+    }
+
+    bool hasLine(int board_size, int win_length) const
+    {
+        // NOTE: shifted-AND line detection
+        //  after (win_length - 1) rounds of x[i] &= shift(x[i + dr]),
+        //  a set bit marks the start of win_length consecutive stones.
+        //  The four directions are (dr, right shift, left shift):
+        //  horizontal (0, 1, 0), vertical (1, 0, 0),
+        //  diagonal (1, 1, 0) and anti-diagonal (1, 0, 1).
+        static const int dr[] = {0, 1, 1, 1};
+        static const int rs[] = {1, 0, 1, 0};
+        static const int ls[] = {0, 0, 0, 1};
+        assertMsg(board_size <= MAX_BOARD_SIZE,
+                  "Board size " + std::to_string(board_size) + " is not supported");
+
+        // rounded up to whole SIMD chunks, zero padded for the x[i + 1] loads
+        int num_rows = (board_size + 7) & ~7;
+        for (int k = 0; k < 4; k++)
+        {
+            alignas(32) uint32_t x[MAX_BOARD_SIZE + 8] = {};
+            uint32_t any = 0;
+            for (int i = 0; i < board_size; i++)
+                any |= x[i] = rows[i];
+            for (int step = 1; step < win_length && any; step++)
+                any = shiftAnd(x, num_rows, dr[k], rs[k], ls[k]);
+            if (any)
+                return true;
+        }
+        return false;
+    }
+
+private:
+    static uint32_t shiftAnd(uint32_t *x, int num_rows, int dr, int rs, int ls)
+    {
+        // NOTE: x[i] is read after x[i + dr] in ascending order,
+        //  so the update can be done in place.
+#if defined(GOBANG_BITBOARD_AVX2)
+        __m256i any = _mm256_setzero_si256();
+        __m128i rs_count = _mm_cvtsi32_si128(rs);
+        __m128i ls_count = _mm_cvtsi32_si128(ls);
+        for (int i = 0; i < num_rows; i += 8)
+        {
+            __m256i cur = _mm256_load_si256(reinterpret_cast<const __m256i *>(x + i));
+            __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i + dr));
+            next = _mm256_sll_epi32(_mm256_srl_epi32(next, rs_count), ls_count);
+            cur = _mm256_and_si256(cur, next);
+            _mm256_store_si256(reinterpret_cast<__m256i *>(x + i), cur);
+            any = _mm256_or_si256(any, cur);
+        }
+        return !_mm256_testz_si256(any, any);
+#elif defined(GOBANG_BITBOARD_SSE2)
+        __m128i any = _mm_setzero_si128();
+        __m128i rs_count = _mm_cvtsi32_si128(rs);
+        __m128i ls_count = _mm_cvtsi32_si128(ls);
+        for (int i = 0; i < num_rows; i += 4)
+        {
+            __m128i cur = _mm_load_si128(reinterpret_cast<const __m128i *>(x + i));
+            __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i + dr));
+            next = _mm_sll_epi32(_mm_srl_epi32(next, rs_count), ls_count);
+            cur = _mm_and_si128(cur, next);
+            _mm_store_si128(reinterpret_cast<__m128i *>(x + i), cur);
+            any = _mm_or_si128(any, cur);
+        }
+        return _mm_movemask_epi8(_mm_cmpeq_epi32(any, _mm_setzero_si128())) != 0xFFFF;
+#else
+        uint32_t any = 0;
+        for (int i = 0; i < num_rows; i++)
+            any |= x[i] &= (x[i + dr] >> rs) << ls;
+        return any;
+#endif
+    }
+};
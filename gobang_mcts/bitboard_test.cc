@@ -0,0 +1,64 @@
+#include "envpool/gobang_mcts/bitboard.hpp"
+
+#include <random>
+#include <gtest/gtest.h>
+
+bool hasLineNaive(const BitBoard &bitboard, int board_size, int win_length)
+{
+    static const int dx[] = {1, 1, 0, -1};
+    static const int dy[] = {0, 1, 1, 1};
+    for (int i = 0; i < board_size; i++)
+        for (int j = 0; j < board_size; j++)
+            for (int k = 0; k < 4; k++)
+            {
+                int x = i, y = j, count = 0;
+                while (x >= 0 && x < board_size &&
+                       y >= 0 && y < board_size && bitboard.test(x, y))
+                {
+                    count++;
+                    x += dx[k];
+                    y += dy[k];
+                }
+                if (count >= win_length)
+                    return true;
+            }
+    return false;
+}
+
+TEST(BitBoardTest, Directions)
+{
+    // horizontal, vertical, diagonal, anti-diagonal
+    static const int dx[] = {0, 1, 1, 1};
+    static const int dy[] = {1, 0, 1, -1};
+    for (int board_size : {5, 8, 15, 19, 32})
+        for (int k = 0; k < 4; k++)
+        {
+            BitBoard bitboard;
+            int x = board_size - 5, y = k == 3 ? board_size - 1 : board_size - 5;
+            for (int i = 0; i < 5; i++)
+            {
+                EXPECT_FALSE(bitboard.hasLine(board_size, 5));
+                bitboard.set(x + i * dx[k], y + i * dy[k]);
+            }
+            EXPECT_TRUE(bitboard.hasLine(board_size, 5));
+            EXPECT_FALSE(bitboard.hasLine(board_size, 6));
+        }
+}
+
+TEST(BitBoardTest, Random)
+{
+    std::mt19937 rng(0);
+    for (int board_size : {3, 9, 15, 19, 32})
+        for (int trial = 0; trial < 200; trial++)
+        {
+            BitBoard bitboard;
+            std::bernoulli_distribution occupied(0.1 + 0.4 * trial / 200);
+            for (int i = 0; i < board_size; i++)
+                for (int j = 0; j < board_size; j++)
+                    if (occupied(rng))
+                        bitboard.set(i, j);
+            for (int win_length = 3; win_length <= 6; win_length++)
+                EXPECT_EQ(bitboard.hasLine(board_size, win_length),
+                          hasLineNaive(bitboard, board_size, win_length));
+        }
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+#include "envpool/gobang_mcts/utils.hpp"
+
+class EvalCache
+{
+    // NOTE: HACK: why do we need EvalCache?
+    // All envs start from the empty board, thus they keep asking the network
+    //  to evaluate the same (early-game) positions again and again.
+    //
+    // Entries are keyed by (position hash, model version) and shared by all envs
+    //  of the process. The cache is split into shards with one mutex each,
+    //  every shard is a fixed-size table with CLOCK (second chance) eviction.
+    //  Memory is bounded by capacity * (action_shape + 4) * 4 bytes.
+public:
+    static constexpr int NUM_SHARDS = 64;
+
+private:
+    struct Entry
+    {
+        uint64_t hash;
+        int model_version;
+        float value;
+        bool referenced;
+        bool valid;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector<Entry> entries;
+        std::vector<float> prior_probs;
+        std::unordered_map<uint64_t, int> slots;
+        int hand = 0;
+    };
+
+    const int action_shape;
+    const int shard_capacity;
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<int64_t> num_hits, num_misses;
+
+    Shard &shardOf(uint64_t hash)
+    {
+        return shards[hash % NUM_SHARDS];
+    }
+
+    int evict(Shard &shard)
+    {
+        // CLOCK: clear the referenced bit until an unreferenced slot is found
+        while (true)
+        {
+            int slot = shard.hand;
+            auto &entry = shard.entries[slot];
+            shard.hand = (shard.hand + 1) % shard_capacity;
+            if (!entry.valid || !entry.referenced)
+                return slot;
+            entry.referenced = false;
+        }
+    }
+
+public:
+    EvalCache(int capacity, int action_shape)
+        : action_shape(action_shape),
+          shard_capacity(std::max(1, (capacity + NUM_SHARDS - 1) / NUM_SHARDS)),
+          shards(new Shard[NUM_SHARDS]), num_hits(0), num_misses(0)
+    {
+        assertMsg(capacity > 0, "EvalCache capacity must be positive");
+        for (int i = 0; i < NUM_SHARDS; ++i)
+        {
+            shards[i].entries.resize(shard_capacity, Entry{0, 0, 0, false, false});
+            shards[i].prior_probs.resize(shard_capacity * action_shape);
+            shards[i].slots.reserve(shard_capacity);
+        }
+    }
+
+    static std::shared_ptr<EvalCache> shared(int capacity, int action_shape, int num_player_planes,
+                                             const std::string &network_id = "")
+    {
+        // NOTE: process-wide instance, shared by all envs with the same specs and network,
+        //  the hashes of different history lengths and networks must not share entries
+        static std::mutex mutex;
+        static std::map<std::tuple<int, int, int, std::string>, std::weak_ptr<EvalCache>> caches;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto &cache = caches[std::make_tuple(capacity, action_shape, num_player_planes, network_id)];
+        auto instance = cache.lock();
+        if (!instance)
+        {
+            instance = std::make_shared<EvalCache>(capacity, action_shape);
+            cache = instance;
+        }
+        return instance;
+    }
+
+    bool lookup(uint64_t hash, int model_version, float *prior_probs, float &value)
+    {
+        auto &shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.slots.find(hash);
+        if (it == shard.slots.end() ||
+            shard.entries[it->second].model_version != model_version)
+        {
+            num_misses++;
+            return false;
+        }
+        auto &entry = shard.entries[it->second];
+        entry.referenced = true;
+        value = entry.value;
+        auto *data = shard.prior_probs.data() + it->second * action_shape;
+        std::copy(data, data + action_shape, prior_probs);
+        num_hits++;
+        return true;
+    }
+
+    void insert(uint64_t hash, int model_version, const float *prior_probs, float value)
+    {
+        auto &shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.slots.find(hash);
+        int slot;
+        if (it != shard.slots.end())
+            slot = it->second;
+        else
+        {
+            slot = evict(shard);
+            if (shard.entries[slot].valid)
+                shard.slots.erase(shard.entries[slot].hash);
+            shard.slots.emplace(hash, slot);
+        }
+        shard.entries[slot] = Entry{hash, model_version, value, false, true};
+        std::copy(prior_probs, prior_probs + action_shape,
+                  shard.prior_probs.data() + slot * action_shape);
+    }
+
+    int64_t numHits() const { return num_hits; }
+    int64_t numMisses() const { return num_misses; }
+
+    double hitRate() const
+    {
+        int64_t hits = num_hits, total = hits + num_misses;
+        return total > 0 ? static_cast<double>(hits) / total : 0.0;
+    }
+};
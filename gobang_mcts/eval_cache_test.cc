@@ -0,0 +1,39 @@
+#include "envpool/gobang_mcts/eval_cache.hpp"
+
+#include <gtest/gtest.h>
+
+TEST(EvalCacheTest, LookupInsert)
+{
+    EvalCache cache(EvalCache::NUM_SHARDS, 4);
+    std::vector<float> prior_probs{.1f, .2f, .3f, .4f}, result(4);
+    float value;
+    EXPECT_FALSE(cache.lookup(42, 0, result.data(), value));
+    cache.insert(42, 0, prior_probs.data(), .5f);
+    EXPECT_TRUE(cache.lookup(42, 0, result.data(), value));
+    EXPECT_EQ(result, prior_probs);
+    EXPECT_EQ(value, .5f);
+    // other model versions miss
+    EXPECT_FALSE(cache.lookup(42, 1, result.data(), value));
+    EXPECT_EQ(cache.numHits(), 1);
+    EXPECT_EQ(cache.numMisses(), 2);
+}
+
+TEST(EvalCacheTest, Eviction)
+{
+    // NOTE: one slot per shard, keys of the same shard evict each other
+    EvalCache cache(EvalCache::NUM_SHARDS, 1);
+    float prior_prob = 1.0f, value;
+    uint64_t hash = 7, other_hash = 7 + EvalCache::NUM_SHARDS;
+    cache.insert(hash, 0, &prior_prob, 0);
+    cache.insert(other_hash, 0, &prior_prob, 0);
+    EXPECT_FALSE(cache.lookup(hash, 0, &prior_prob, value));
+    EXPECT_TRUE(cache.lookup(other_hash, 0, &prior_prob, value));
+
+    // bounded memory: many inserts keep at most one entry per shard
+    for (uint64_t i = 0; i < 10000; ++i)
+        cache.insert(i, 0, &prior_prob, 0);
+    int num_cached = 0;
+    for (uint64_t i = 0; i < 10000; ++i)
+        num_cached += cache.lookup(i, 0, &prior_prob, value);
+    EXPECT_EQ(num_cached, EvalCache::NUM_SHARDS);
+}
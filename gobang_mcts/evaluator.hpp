@@ -0,0 +1,159 @@
+#pragma once
+
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "envpool/gobang_mcts/utils.hpp"
+#include "envpool/gobang_mcts/gobang_env.hpp"
+
+template <typename Env>
+class RolloutEvaluatorT
+{
+    // NOTE: network-free leaf evaluator, called as
+    //  float evaluator(GobangEnv &env, std::vector<float> &prior_probs)
+    //  like the evaluators of ParallelMCTS, env is left unchanged.
+    //
+    // prior_probs are uniform, or heuristic (proximity to stones, wins & blocks).
+    //  The value is the mean result of num_rollouts playouts (0 if num_rollouts = 0)
+    //  from the view of the player who made the last move, i.e., as expected by backPropagate.
+    //  Random playouts pick uniform legal moves, heuristic playouts take wins,
+    //  block the opponent's wins and otherwise prefer moves next to a stone.
+private:
+    using Board = typename Env::Board;
+
+    int num_rollouts;
+    bool heuristic;
+    uint32_t seed;
+    std::mt19937 rng;
+    Env rollout_env;
+
+    static int findWinningAction(const Board &board, int player,
+                                 int around, int win_length)
+    {
+        // NOTE: a line completed by player must pass through its last stone,
+        //  thus only the four lines through around are checked
+        int board_size = board.board_size;
+        int row = around / board_size, col = around % board_size;
+        for (int k = 0; k < 4; k++)
+            for (int d = 1 - win_length; d < win_length; d++)
+            {
+                int x = row + d * Board::DX[k], y = col + d * Board::DY[k];
+                if (x < 0 || x >= board_size || y < 0 || y >= board_size)
+                    continue;
+                int index = x * board_size + y;
+                if (board.at(index) == -1 && board.completesLine(index, player, win_length))
+                    return index;
+            }
+        return -1;
+    }
+
+    static int countNeighbours(const Board &board, int index, int radius)
+    {
+        int board_size = board.board_size, count = 0;
+        int row = index / board_size, col = index % board_size;
+        for (int x = std::max(0, row - radius); x <= std::min(board_size - 1, row + radius); x++)
+            for (int y = std::max(0, col - radius); y <= std::min(board_size - 1, col + radius); y++)
+                count += board.at(x * board_size + y) != -1;
+        return count;
+    }
+
+    int selectRolloutAction(const Board &board, int win_length)
+    {
+        const auto &actions = board.getActions();
+        const auto &history = board.historical_actions;
+        if (heuristic && !history.empty())
+        {
+            // win, or block
+            int action = -1;
+            if (history.size() >= 2)
+                action = findWinningAction(board, board.player, history[history.size() - 2], win_length);
+            if (action == -1)
+                action = findWinningAction(board, board.player ^ 1, history.back(), win_length);
+            if (action != -1)
+                return action;
+            // NOTE: a few tries to find a move next to a stone
+            for (int i = 0; i < 8; i++)
+            {
+                action = actions[rng() % actions.size()];
+                if (countNeighbours(board, action, 1) > 0)
+                    return action;
+            }
+            return action;
+        }
+        return actions[rng() % actions.size()];
+    }
+
+    float rollout(const Env &env)
+    {
+        rollout_env = env;
+        int last_player = env.getBoard().player ^ 1;
+        while (true)
+        {
+            const auto &board = rollout_env.getBoard();
+            rollout_env.step(selectRolloutAction(board, rollout_env.winLength()));
+            auto result = rollout_env.checkFinished();
+            if (result.first)
+                return result.second == -1 ? 0.0f : result.second == last_player ? 1.0f
+                                                                                : -1.0f;
+        }
+    }
+
+    void computePriors(const Env &env, std::vector<float> &prior_probs)
+    {
+        const auto &board = env.getBoard();
+        const auto &actions = board.getActions();
+        std::fill(prior_probs.begin(), prior_probs.end(), 0.0f);
+        if (!heuristic)
+        {
+            for (auto action : actions)
+                prior_probs[action] = 1.0f / actions.size();
+            return;
+        }
+        float sum = 0;
+        for (auto action : actions)
+        {
+            float score = 1.0f + countNeighbours(board, action, 1) * 2.0f +
+                          countNeighbours(board, action, 2);
+            if (board.completesLine(action, board.player, env.winLength()))
+                score *= 100.0f;
+            else if (board.completesLine(action, board.player ^ 1, env.winLength()))
+                score *= 50.0f;
+            prior_probs[action] = score;
+            sum += score;
+        }
+        for (auto action : actions)
+            prior_probs[action] /= sum;
+    }
+
+public:
+    RolloutEvaluatorT(int board_size, int win_length, int num_rollouts = 1,
+                     bool heuristic = false, uint32_t seed = 0)
+        : num_rollouts(num_rollouts), heuristic(heuristic), seed(seed), rng(seed),
+          rollout_env(board_size, win_length)
+    {
+        assertMsg(num_rollouts >= 0, "num_rollouts must be non-negative");
+    }
+
+    void setStream(uint32_t stream)
+    {
+        // NOTE: restart rng on a stream derived from (seed, stream),
+        //  copies with distinct streams play distinct rollouts, see ParallelMCTS::search()
+        std::seed_seq seq{seed, stream};
+        rng.seed(seq);
+    }
+
+    float operator()(Env &env, std::vector<float> &prior_probs)
+    {
+        computePriors(env, prior_probs);
+        if (num_rollouts == 0)
+            return 0.0f;
+        float value = 0;
+        for (int i = 0; i < num_rollouts; i++)
+            value += rollout(env);
+        return value / num_rollouts;
+    }
+};
+
+using RolloutEvaluator = RolloutEvaluatorT<GobangEnv>;
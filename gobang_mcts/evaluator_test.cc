@@ -0,0 +1,90 @@
+#include "envpool/gobang_mcts/evaluator.hpp"
+#include "envpool/gobang_mcts/parallel_mcts.hpp"
+
+#include <numeric>
+#include <gtest/gtest.h>
+
+TEST(RolloutEvaluatorTest, Priors)
+{
+    GobangEnv env(9, 5);
+    env.reset();
+    for (auto action : {40, 0, 41, 1, 42, 2, 43})
+        env.step(action);
+    std::vector<float> prior_probs(9 * 9);
+    for (bool heuristic : {false, true})
+    {
+        RolloutEvaluator evaluator(9, 5, 0, heuristic);
+        EXPECT_EQ(evaluator(env, prior_probs), 0.0f);
+        EXPECT_NEAR(std::accumulate(prior_probs.begin(), prior_probs.end(), 0.0f), 1.0f, 1e-5);
+        for (int i = 0; i < 9 * 9; i++)
+        {
+            if (env.getBoard().at(i) != -1)
+            {
+                EXPECT_EQ(prior_probs[i], 0.0f);
+            }
+        }
+        if (heuristic)
+        {
+            // player 1 has to block 39 or 44
+            int best_action = std::max_element(prior_probs.begin(), prior_probs.end()) -
+                              prior_probs.begin();
+            EXPECT_TRUE(best_action == 39 || best_action == 44);
+        }
+    }
+}
+
+TEST(RolloutEvaluatorTest, Rollout)
+{
+    // NOTE: player 0 (to move) wins at 44, i.e., the last mover loses
+    GobangEnv env(9, 5);
+    env.reset();
+    for (auto action : {40, 0, 41, 1, 42, 2, 43, 80})
+        env.step(action);
+    auto hash = env.getHash();
+    std::vector<float> prior_probs(9 * 9);
+    RolloutEvaluator heuristic_evaluator(9, 5, 16, true, 0);
+    EXPECT_EQ(heuristic_evaluator(env, prior_probs), -1.0f);
+    EXPECT_EQ(env.getHash(), hash); // env is left unchanged
+
+    RolloutEvaluator random_evaluator(9, 5, 64, false, 0);
+    float value = random_evaluator(env, prior_probs);
+    EXPECT_GE(value, -1.0f);
+    EXPECT_LT(value, 0.0f);
+    EXPECT_EQ(env.getActions().size(), 9 * 9 - 8);
+}
+
+TEST(RolloutEvaluatorTest, Stream)
+{
+    // NOTE: copies on the same stream repeat the same rollouts, distinct streams do not
+    GobangEnv env(9, 5);
+    env.reset();
+    env.step(40);
+    std::vector<float> prior_probs(9 * 9);
+    RolloutEvaluator evaluator(9, 5, 1, false, 0);
+    std::vector<std::vector<float>> values(3);
+    for (uint32_t stream = 0; stream < 3; ++stream)
+    {
+        RolloutEvaluator thread_evaluator(evaluator);
+        thread_evaluator.setStream(stream == 2 ? 0 : stream);
+        for (int i = 0; i < 32; ++i)
+            values[stream].push_back(thread_evaluator(env, prior_probs));
+    }
+    EXPECT_EQ(values[0], values[2]);
+    EXPECT_NE(values[0], values[1]);
+}
+
+TEST(RolloutEvaluatorTest, ParallelMCTS)
+{
+    GobangEnv env(9, 5);
+    env.reset();
+    for (auto action : {40, 0, 41, 1, 42, 2, 43, 80})
+        env.step(action);
+    ParallelMCTS<GobangEnv> mcts(1.0, 400, env);
+    mcts.search(2, RolloutEvaluator(9, 5, 1, true, 0));
+    auto result = mcts.getResult();
+    auto best = std::max_element(
+        result.begin(), result.end(),
+        [](const std::pair<int, int> &a, const std::pair<int, int> &b)
+        { return a.second < b.second; });
+    EXPECT_TRUE(best->first == 39 || best->first == 44);
+}
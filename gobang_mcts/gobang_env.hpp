@@ -1,71 +1,388 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <iostream>
 #include <cassert>
 #include <utility>
+#include <numeric>
+#include <algorithm>
 
 #include "envpool/gobang_mcts/utils.hpp"
+#include "envpool/gobang_mcts/bitboard.hpp"
+#include "envpool/gobang_mcts/symmetry.hpp"
+#include "envpool/gobang_mcts/zobrist.hpp"
+#include "envpool/gobang_mcts/inline_vector.hpp"
 
-struct GobangBoard
+template <int N>
+struct BoardSize
+{
+    // NOTE: a compile-time board size, see GobangBoardT
+    static constexpr int board_size = N;
+
+    explicit BoardSize(int board_size)
+    {
+        assertMsg(board_size == N, "Board size " + std::to_string(board_size) +
+                                       " does not match " + std::to_string(N));
+    }
+};
+
+template <>
+struct BoardSize<0>
 {
     int board_size;
-    std::vector<int> board;
+
+    explicit BoardSize(int board_size) : board_size(board_size) {}
+};
+
+template <int N = 0>
+struct GobangBoardT : BoardSize<N>
+{
+    // NOTE: N > 0 fixes the board size at compile time, i.e., the loops over the board
+    //  have constant trip counts and all the arrays are stored inline (trivially copyable),
+    //  N = 0 is the dynamic board (GobangBoard) that supports any size
+    using BoardSize<N>::board_size;
+    static constexpr int DX[] = {1, 1, 0, -1};
+    static constexpr int DY[] = {0, 1, 1, 1};
+
+    BitBoard stones[2];
     int player;
-    std::vector<int> historical_actions;
+    BoardVector<int, N> historical_actions;
+
+    // NOTE: legal moves are kept in a dense array with swap-remove,
+    //  legal_positions[action] is the position of action in legal_actions (-1 if occupied)
+    BoardVector<int, N> legal_actions;
+    BoardVector<int, N> legal_positions;
 
-    GobangBoard(int board_size)
-        : board_size(board_size), player(0)
+    // NOTE: undo() reverts step() exactly, incl. the order of legal_actions & candidate_actions,
+    //  removed_positions[h] / removed_candidates[h] are the positions that
+    //  historical_actions[h] was swap-removed from (-1 if it was not a candidate)
+    BoardVector<int, N> removed_positions;
+    BoardVector<int, N> removed_candidates;
+
+    // NOTE: candidate moves (optional, candidate_radius > 0) are the empty cells
+    //  within candidate_radius (Chebyshev) of a stone, or the centre on an empty board.
+    //  neighbour_counts[action] is the # stones around action, kept in the same way
+    //  as the legal moves, i.e., dense array + positions, updated in step()
+    int candidate_radius;
+    BoardVector<int, N> candidate_actions;
+    BoardVector<int, N> candidate_positions;
+    BoardVector<uint8_t, N> neighbour_counts;
+
+    // NOTE: Zobrist hash of the position under each symmetry,
+    //  hashes[0] is the hash of the board as it is. Only the first num_hashes are maintained,
+    //  i.e., all of them for canonical hashes (see setCanonicalHash()), hashes[0] otherwise
+    const int *symmetries;
+    int num_hashes;
+    std::array<uint64_t, Symmetry::NUM_SYMMETRIES> hashes;
+
+    GobangBoardT(int board_size, int candidate_radius = 0, bool canonical_hash = false)
+        : BoardSize<N>(board_size), player(0), candidate_radius(candidate_radius),
+          symmetries(Symmetry::permutations(board_size)),
+          num_hashes(canonical_hash ? Symmetry::NUM_SYMMETRIES : 1), hashes{}
     {
-        board.resize(board_size * board_size, -1);
+        assertMsg(board_size > 0 && board_size <= BitBoard::MAX_BOARD_SIZE,
+                  "Invalid board size " + std::to_string(board_size));
+        // NOTE: neighbour_counts are uint8_t, i.e., (2 * radius + 1)^2 < 256
+        assertMsg(candidate_radius >= 0 && candidate_radius <= 7,
+                  "candidate_radius must be in [0, 7]");
         historical_actions.reserve(board_size * board_size);
+        removed_positions.reserve(board_size * board_size);
+        legal_actions.resize(board_size * board_size);
+        std::iota(legal_actions.begin(), legal_actions.end(), 0);
+        legal_positions = legal_actions;
+        if (candidate_radius > 0)
+        {
+            int centre = board_size / 2 * board_size + board_size / 2;
+            candidate_actions.assign(1, centre);
+            candidate_positions.assign(board_size * board_size, -1);
+            candidate_positions[centre] = 0;
+            neighbour_counts.assign(board_size * board_size, 0);
+            removed_candidates.reserve(board_size * board_size);
+        }
+    }
+
+    int at(int index) const
+    {
+        int row = index / board_size, col = index % board_size;
+        return stones[0].test(row, col)   ? 0
+               : stones[1].test(row, col) ? 1
+                                          : -1;
+    }
+
+    void setCanonicalHash(bool canonical_hash)
+    {
+        // NOTE: the hashes of the enabled symmetries are recomputed from the stones
+        num_hashes = canonical_hash ? Symmetry::NUM_SYMMETRIES : 1;
+        hashes.fill(0);
+        for (int index = 0; index < board_size * board_size; ++index)
+        {
+            int stone = at(index);
+            if (stone != -1)
+                for (int s = 0; s < num_hashes; s++)
+                    hashes[s] ^= Zobrist::key(stone, symmetries[s * board_size * board_size + index]);
+        }
     }
 
     void step(int index)
     {
-        assertMsg(index >= 0 && index < board.size(),
+        assertMsg(index >= 0 && index < board_size * board_size,
                   "Invalid index " + std::to_string(index));
-        assertMsg(board[index] == -1,
+        assertMsg(at(index) == -1,
                   "Invalid index " + std::to_string(index));
-        board[index] = player;
+        stones[player].set(index / board_size, index % board_size);
+        for (int s = 0; s < num_hashes; s++)
+            hashes[s] ^= Zobrist::key(player, symmetries[s * board_size * board_size + index]);
         player ^= 1;
         historical_actions.push_back(index);
+
+        int position = legal_positions[index];
+        int last_action = legal_actions.back();
+        legal_actions[position] = last_action;
+        legal_positions[last_action] = position;
+        legal_actions.pop_back();
+        legal_positions[index] = -1;
+        removed_positions.push_back(position);
+
+        if (candidate_radius > 0)
+            updateCandidates(index);
     }
 
-    std::vector<int> getActions()
+    void undo()
     {
-        std::vector<int> actions;
-        for (int i = 0; i < board_size; i++)
-            for (int j = 0; j < board_size; j++)
-                if (board[i * board_size + j] == -1)
-                    actions.push_back(i * board_size + j);
-        return actions;
+        // NOTE: O(1) (O(radius^2) with candidates) & no allocation, reverts the last step()
+        assertMsg(!historical_actions.empty(), "No action to undo");
+        int index = historical_actions.back();
+        if (candidate_radius > 0)
+            revertCandidates(index);
+
+        restore(legal_actions, legal_positions, index, removed_positions.back());
+        removed_positions.pop_back();
+        historical_actions.pop_back();
+        player ^= 1;
+        for (int s = 0; s < num_hashes; s++)
+            hashes[s] ^= Zobrist::key(player, symmetries[s * board_size * board_size + index]);
+        stones[player].reset(index / board_size, index % board_size);
+    }
+
+    template <typename Vector>
+    static void restore(Vector &actions, Vector &positions, int action, int position)
+    {
+        // NOTE: inverse of the swap-remove of action from position
+        if (position == -1)
+            return;
+        if (position == static_cast<int>(actions.size()))
+            actions.push_back(action);
+        else
+        {
+            int moved_action = actions[position];
+            positions[moved_action] = actions.size();
+            actions.push_back(moved_action);
+            actions[position] = action;
+        }
+        positions[action] = position;
+    }
+
+    void addCandidate(int action)
+    {
+        candidate_positions[action] = candidate_actions.size();
+        candidate_actions.push_back(action);
+    }
+
+    void removeCandidate(int action)
+    {
+        int position = candidate_positions[action];
+        if (position == -1)
+            return;
+        int last_action = candidate_actions.back();
+        candidate_actions[position] = last_action;
+        candidate_positions[last_action] = position;
+        candidate_actions.pop_back();
+        candidate_positions[action] = -1;
+    }
+
+    void updateCandidates(int index)
+    {
+        // NOTE: O(radius^2) per move, the centre fallback is dropped by the first move
+        if (historical_actions.size() == 1)
+            removeCandidate(board_size / 2 * board_size + board_size / 2);
+        removed_candidates.push_back(candidate_positions[index]);
+        removeCandidate(index);
+        int row = index / board_size, col = index % board_size;
+        int min_x = std::max(0, row - candidate_radius), max_x = std::min(board_size - 1, row + candidate_radius);
+        int min_y = std::max(0, col - candidate_radius), max_y = std::min(board_size - 1, col + candidate_radius);
+        for (int x = min_x; x <= max_x; x++)
+            for (int y = min_y; y <= max_y; y++)
+            {
+                int action = x * board_size + y;
+                if (neighbour_counts[action]++ == 0 && legal_positions[action] != -1)
+                    addCandidate(action);
+            }
+    }
+
+    void revertCandidates(int index)
+    {
+        // NOTE: the candidates added by index are the last ones, removed in reverse order
+        int row = index / board_size, col = index % board_size;
+        int min_x = std::max(0, row - candidate_radius), max_x = std::min(board_size - 1, row + candidate_radius);
+        int min_y = std::max(0, col - candidate_radius), max_y = std::min(board_size - 1, col + candidate_radius);
+        for (int x = max_x; x >= min_x; x--)
+            for (int y = max_y; y >= min_y; y--)
+            {
+                int action = x * board_size + y;
+                if (--neighbour_counts[action] == 0 && legal_positions[action] != -1)
+                    removeCandidate(action);
+            }
+        restore(candidate_actions, candidate_positions, index, removed_candidates.back());
+        removed_candidates.pop_back();
+        if (historical_actions.size() == 1)
+        {
+            // NOTE: back to the empty board, i.e., only the centre fallback
+            int centre = board_size / 2 * board_size + board_size / 2;
+            candidate_actions.assign(1, centre);
+            candidate_positions[centre] = 0;
+        }
+    }
+
+    const BoardVector<int, N> &getActions() const
+    {
+        // NOTE: candidate moves if enabled, all legal moves otherwise
+        return candidate_radius > 0 ? candidate_actions : legal_actions;
+    }
+
+    std::pair<uint64_t, int> hash(bool canonical, int num_history = 0) const
+    {
+        // NOTE: returns (hash, symmetry), the canonical hash is the minimum
+        //  over all symmetries and symmetry is the one that attains it.
+        //  The last num_history moves are mixed in under the same symmetry,
+        //  i.e., positions are only equal if their history planes are equal
+        assertMsg(!canonical || num_hashes == Symmetry::NUM_SYMMETRIES,
+                  "Canonical hashes are disabled, see setCanonicalHash()");
+        int symmetry = canonical ? std::min_element(hashes.begin(), hashes.begin() + num_hashes) - hashes.begin() : 0;
+        uint64_t hash = hashes[symmetry];
+        int num_actions = historical_actions.size();
+        for (int lag = 0; lag < std::min(num_history, num_actions); ++lag)
+            hash ^= Zobrist::historyKey(
+                lag, symmetries[symmetry * board_size * board_size + historical_actions[num_actions - 1 - lag]]);
+        return std::make_pair(hash, symmetry);
+    }
+
+    bool isWinningMove(int index, int win_length) const
+    {
+        return completesLine(index, at(index), win_length);
+    }
+
+    bool completesLine(int index, int player, int win_length) const
+    {
+        // NOTE: whether a stone of player at index would complete a line,
+        //  only walks the four lines through index,
+        //  i.e., O(win_length) instead of a full board scan
+        int row = index / board_size, col = index % board_size;
+        const BitBoard &own = stones[player];
+        auto isOwn = [&](int x, int y)
+        {
+            return x >= 0 && x < board_size &&
+                   y >= 0 && y < board_size && own.test(x, y);
+        };
+        for (int k = 0; k < 4; k++)
+        {
+            int count = 1;
+            for (int x = row + DX[k], y = col + DY[k];
+                 count < win_length && isOwn(x, y); x += DX[k], y += DY[k])
+                count++;
+            for (int x = row - DX[k], y = col - DY[k];
+                 count < win_length && isOwn(x, y); x -= DX[k], y -= DY[k])
+                count++;
+            if (count >= win_length)
+                return true;
+        }
+        return false;
+    }
+
+    int findWinner(int win_length) const
+    {
+        for (int i = 0; i < 2; i++)
+            if (stones[i].hasLine(board_size, win_length))
+                return i;
+        return -1;
+    }
+
+    template <typename T>
+    void encode(int num_player_planes, T *output) const
+    {
+        // NOTE: write the planes straight into output, [2P + 1, N, N]
+        //  planes [0, P) / [P, 2P) are the stones of player 0 / 1 in the last P turns,
+        //  plane i is plane i - 1 without the move (delta) of that player in turn i,
+        //  the last plane is filled with the current player
+        auto flatten_size = board_size * board_size;
+        auto num_actions = static_cast<int>(historical_actions.size());
+        for (int k = 0; k < 2; k++)
+        {
+            T *plane = output + k * num_player_planes * flatten_size;
+            std::fill(plane, plane + flatten_size, 0);
+            for (int row = 0; row < board_size; row++)
+                for (uint32_t bits = stones[k].rows[row]; bits; bits &= bits - 1)
+                    plane[row * board_size + __builtin_ctz(bits)] = 1;
+
+            // NOTE: historical_actions[h] is a stone of player h % 2
+            int h = num_actions - 1;
+            if (h >= 0 && h % 2 != k)
+                h--;
+            for (int i = 1; i < num_player_planes; ++i, h -= 2)
+            {
+                std::copy(plane, plane + flatten_size, plane + flatten_size);
+                plane += flatten_size;
+                if (h >= 0)
+                    plane[historical_actions[h]] = 0;
+            }
+        }
+
+        std::fill(output + num_player_planes * 2 * flatten_size,
+                  output + (num_player_planes * 2 + 1) * flatten_size, player);
     }
 
-    std::vector<int> encode(int num_player_planes)
+    void encode(int num_player_planes, uint64_t *output) const
     {
-        auto flatten_size = board.size();
-        std::vector<int> board_copy(board);
-        std::vector<int> encoded_state((num_player_planes * 2 + 1) * flatten_size);
-        int action_offset = 1; // historical_actions[-1]
-        for (int i = 0; i < num_player_planes; ++i)
+        // NOTE: bit-packed planes, [2P + 1, ceil(N * N / 64)] words,
+        //  cell i of a plane is bit i % 64 of word i / 64 (little endian)
+        auto flatten_size = board_size * board_size;
+        int num_words = (flatten_size + 63) / 64;
+        auto num_actions = static_cast<int>(historical_actions.size());
+        for (int k = 0; k < 2; k++)
         {
-            for (int j = 0; j < flatten_size; j++)
-                encoded_state[i * flatten_size + j] = board_copy[j] == 0;
-            for (int j = 0; j < flatten_size; j++)
-                encoded_state[(i + num_player_planes) * flatten_size + j] = board_copy[j] == 1;
-
-            for (int j = 0; j < 2; j++)
-                if (action_offset <= historical_actions.size())
-                {
-                    int action = *(historical_actions.end() - action_offset);
-                    board_copy[action] = -1;
-                    action_offset++;
-                }
+            uint64_t *plane = output + k * num_player_planes * num_words;
+            std::fill(plane, plane + num_words, 0);
+            for (int row = 0, offset = 0; row < board_size; row++, offset += board_size)
+            {
+                uint64_t bits = stones[k].rows[row];
+                int word = offset / 64, shift = offset % 64;
+                plane[word] |= bits << shift;
+                if (shift + board_size > 64)
+                    plane[word + 1] |= bits >> (64 - shift);
+            }
+
+            int h = num_actions - 1;
+            if (h >= 0 && h % 2 != k)
+                h--;
+            for (int i = 1; i < num_player_planes; ++i, h -= 2)
+            {
+                std::copy(plane, plane + num_words, plane + num_words);
+                plane += num_words;
+                if (h >= 0)
+                    plane[historical_actions[h] / 64] &= ~(1ull << (historical_actions[h] % 64));
+            }
         }
 
-        for (int i = 0; i < flatten_size; i++)
-            encoded_state[num_player_planes * 2 * flatten_size + i] = player;
+        uint64_t *plane = output + num_player_planes * 2 * num_words;
+        std::fill(plane, plane + num_words, player ? ~0ull : 0ull);
+        if (player && flatten_size % 64)
+            plane[num_words - 1] &= (1ull << (flatten_size % 64)) - 1;
+    }
+
+    std::vector<int> encode(int num_player_planes) const
+    {
+        std::vector<int> encoded_state((num_player_planes * 2 + 1) * board_size * board_size);
+        encode(num_player_planes, encoded_state.data());
         return encoded_state;
     }
 
@@ -76,10 +393,10 @@ struct GobangBoard
         {
             for (int j = 0; j < board_size; j++)
             {
-                std::cout << (board[i * board_size + j] == -1
-                                  ? " -"
-                              : board[i * board_size + j] == 0 ? " O"
-                                                               : " X");
+                int cell = at(i * board_size + j);
+                std::cout << (cell == -1  ? " -"
+                              : cell == 0 ? " O"
+                                          : " X");
             }
             std::cout << std::endl;
         }
@@ -90,36 +407,55 @@ struct GobangBoard
     }
 };
 
-class GobangEnv
+using GobangBoard = GobangBoardT<>;
+
+template <int N = 0, int K = 0>
+class GobangEnvT
 {
+    // NOTE: K > 0 fixes the win length at compile time, see GobangBoardT
+public:
+    using Board = GobangBoardT<N>;
+
 private:
-    GobangBoard board;
+    Board board;
     int win_length;
     int winner;
 
 public:
-    GobangEnv(int board_size, int win_length)
-        : board(board_size), win_length(win_length), winner(-1)
+    GobangEnvT(int board_size, int win_length, int candidate_radius = 0)
+        : board(board_size, candidate_radius), win_length(win_length), winner(-1)
     {
+        assertMsg(K == 0 || win_length == K, "Win length " + std::to_string(win_length) +
+                                                 " does not match " + std::to_string(K));
     }
 
     void reset()
     {
-        board = GobangBoard(board.board_size);
+        board = Board(board.board_size, board.candidate_radius, board.num_hashes > 1);
         winner = -1;
     }
 
-    void setStat(const GobangBoard &stat)
+    void setStat(const Board &stat)
     {
         this->board = stat;
         this->winner = -1;
     }
 
-    GobangBoard getStat()
+    Board getStat()
+    {
+        return board;
+    }
+
+    const Board &getBoard() const
     {
         return board;
     }
 
+    int winLength() const
+    {
+        return K > 0 ? K : win_length;
+    }
+
     void display()
     {
         board.display();
@@ -130,45 +466,63 @@ public:
         board.step(index);
     }
 
-    std::vector<int> getActions()
+    void undo()
+    {
+        // NOTE: the position before the last step() is never finished
+        board.undo();
+        winner = -1;
+    }
+
+    const BoardVector<int, N> &getActions() const
     {
         return board.getActions();
     }
 
+    void setCanonicalHash(bool canonical_hash)
+    {
+        // NOTE: getHash(true) needs the hashes of all symmetries, which are off by default,
+        //  the setting is kept by reset()
+        board.setCanonicalHash(canonical_hash);
+    }
+
+    std::pair<uint64_t, int> getHash(bool canonical = false, int num_history = 0) const
+    {
+        return board.hash(canonical, num_history);
+    }
+
+    int transformAction(int symmetry, int action) const
+    {
+        return board.symmetries[symmetry * actionShape() + action];
+    }
+
     std::pair<bool, int> checkFinished()
     {
+        // NOTE: incremental check, only the last move can complete a line.
+        //  This relies on checkFinished being called after every step,
+        //  use checkFinishedFull otherwise.
         assertMsg(winner == -1, "Game has already finished");
-        static const int dx[] = {1, 1, 0, -1};
-        static const int dy[] = {0, 1, 1, 1};
-        int blank_count = 0;
-        for (int i = 0; i < board.board_size; i++)
-            for (int j = 0; j < board.board_size; j++)
+        if (!board.historical_actions.empty())
+        {
+            int last_action = board.historical_actions.back();
+            if (board.isWinningMove(last_action, winLength()))
             {
-                if (board.board[i * board.board_size + j] == -1)
-                {
-                    blank_count++;
-                    continue;
-                }
-                for (int k = 0; k < 4; k++)
-                {
-                    int x = i, y = j, count = 0;
-                    int color = board.board[i * board.board_size + j];
-                    while (x >= 0 && x < board.board_size &&
-                           y >= 0 && y < board.board_size &&
-                           board.board[x * board.board_size + y] == color)
-                    {
-                        count++;
-                        x += dx[k];
-                        y += dy[k];
-                    }
-                    if (count >= win_length)
-                    {
-                        winner = color;
-                        return std::make_pair(true, winner);
-                    }
-                }
+                winner = board.at(last_action);
+                return std::make_pair(true, winner);
             }
-        if (blank_count == 0)
+        }
+        if (board.legal_actions.empty())
+            return std::make_pair(true, -1);
+        return std::make_pair(false, -1);
+    }
+
+    std::pair<bool, int> checkFinishedFull()
+    {
+        // NOTE: full board scan, kept for verification
+        assertMsg(winner == -1, "Game has already finished");
+        winner = board.findWinner(winLength());
+        if (winner != -1)
+            return std::make_pair(true, winner);
+        if (board.legal_actions.empty())
             return std::make_pair(true, -1);
         return std::make_pair(false, -1);
     }
@@ -178,8 +532,24 @@ public:
         return board.encode(num_player_planes);
     }
 
+    template <typename T>
+    void writeState(int num_player_planes, T *output) const
+    {
+        // NOTE: int / uint8_t planes, or bit-packed planes for uint64_t
+        board.encode(num_player_planes, output);
+    }
+
+    int stateSize(int num_player_planes, bool packed = false) const
+    {
+        // NOTE: # elements written by writeState(), # words if packed
+        int flatten_size = board.board_size * board.board_size;
+        return (num_player_planes * 2 + 1) * (packed ? (flatten_size + 63) / 64 : flatten_size);
+    }
+
     int actionShape() const
     {
         return board.board_size * board.board_size;
     }
-};
\ No newline at end of file
+};
+
+using GobangEnv = GobangEnvT<>;
@@ -0,0 +1,168 @@
+#include "envpool/gobang_mcts/gobang_env.hpp"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <benchmark/benchmark.h>
+
+static std::vector<int> randomGame(int board_size, int win_length, uint32_t seed = 0)
+{
+    // NOTE: uniform random moves until the game is finished
+    GobangEnv env(board_size, win_length);
+    env.reset();
+    std::mt19937 rng(seed);
+    std::vector<int> actions;
+    while (true)
+    {
+        const auto &valid_actions = env.getActions();
+        actions.push_back(valid_actions[rng() % valid_actions.size()]);
+        env.step(actions.back());
+        if (env.checkFinished().first)
+            return actions;
+    }
+}
+
+static GobangBoard midGameBoard(int board_size, int candidate_radius = 0)
+{
+    // NOTE: half of the moves of a random game
+    auto actions = randomGame(board_size, 5);
+    GobangBoard board(board_size, candidate_radius);
+    for (size_t i = 0; i < actions.size() / 2; ++i)
+        board.step(actions[i]);
+    return board;
+}
+
+static void BM_BoardStep(benchmark::State &state)
+{
+    // NOTE: ns per move, including the copy of an empty board per game, args: board_size
+    int board_size = state.range(0);
+    auto actions = randomGame(board_size, 5);
+    GobangBoard empty_board(board_size);
+    for (auto _ : state)
+    {
+        GobangBoard board = empty_board;
+        for (auto action : actions)
+            board.step(action);
+        benchmark::DoNotOptimize(board.hashes[0]);
+    }
+    state.SetItemsProcessed(state.iterations() * actions.size());
+}
+BENCHMARK(BM_BoardStep)->Arg(9)->Arg(15)->Arg(19);
+
+template <int N>
+static void BM_FixedBoardStep(benchmark::State &state)
+{
+    // NOTE: same as BM_BoardStep with the compile-time board
+    auto actions = randomGame(N, 5);
+    GobangBoardT<N> empty_board(N);
+    for (auto _ : state)
+    {
+        GobangBoardT<N> board = empty_board;
+        for (auto action : actions)
+            board.step(action);
+        benchmark::DoNotOptimize(board.hashes[0]);
+    }
+    state.SetItemsProcessed(state.iterations() * actions.size());
+}
+BENCHMARK_TEMPLATE(BM_FixedBoardStep, 9);
+BENCHMARK_TEMPLATE(BM_FixedBoardStep, 15);
+BENCHMARK_TEMPLATE(BM_FixedBoardStep, 19);
+
+static void BM_GetActions(benchmark::State &state)
+{
+    // NOTE: args: board_size, candidate_radius
+    auto board = midGameBoard(state.range(0), state.range(1));
+    for (auto _ : state)
+    {
+        const auto &actions = board.getActions();
+        benchmark::DoNotOptimize(actions.data());
+        benchmark::DoNotOptimize(actions.size());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetActions)->ArgsProduct({{9, 15, 19}, {0, 2}});
+
+template <typename T>
+static void BM_Encode(benchmark::State &state)
+{
+    // NOTE: args: board_size, num_player_planes
+    int board_size = state.range(0), num_player_planes = state.range(1);
+    auto board = midGameBoard(board_size);
+    GobangEnv env(board_size, 5);
+    std::vector<T> output(env.stateSize(num_player_planes, std::is_same<T, uint64_t>::value));
+    for (auto _ : state)
+    {
+        board.encode(num_player_planes, output.data());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * output.size() * sizeof(T));
+}
+BENCHMARK_TEMPLATE(BM_Encode, int)->ArgsProduct({{9, 15, 19}, {1, 4, 8}});
+BENCHMARK_TEMPLATE(BM_Encode, uint8_t)->ArgsProduct({{9, 15, 19}, {1, 4, 8}});
+BENCHMARK_TEMPLATE(BM_Encode, uint64_t)->ArgsProduct({{9, 15, 19}, {1, 4, 8}});
+
+static void BM_CheckFinished(benchmark::State &state)
+{
+    // NOTE: ns per step() + checkFinished() of a whole random game, args: board_size
+    int board_size = state.range(0);
+    auto actions = randomGame(board_size, 5);
+    GobangEnv empty_env(board_size, 5);
+    empty_env.reset();
+    for (auto _ : state)
+    {
+        GobangEnv env = empty_env;
+        bool done = false;
+        for (auto action : actions)
+        {
+            env.step(action);
+            done = env.checkFinished().first;
+        }
+        benchmark::DoNotOptimize(done);
+    }
+    state.SetItemsProcessed(state.iterations() * actions.size());
+}
+BENCHMARK(BM_CheckFinished)->Arg(9)->Arg(15)->Arg(19);
+
+template <int N>
+static void BM_FixedCheckFinished(benchmark::State &state)
+{
+    // NOTE: same as BM_CheckFinished with the compile-time board & win length
+    auto actions = randomGame(N, 5);
+    GobangEnvT<N, 5> empty_env(N, 5);
+    empty_env.reset();
+    for (auto _ : state)
+    {
+        GobangEnvT<N, 5> env = empty_env;
+        bool done = false;
+        for (auto action : actions)
+        {
+            env.step(action);
+            done = env.checkFinished().first;
+        }
+        benchmark::DoNotOptimize(done);
+    }
+    state.SetItemsProcessed(state.iterations() * actions.size());
+}
+BENCHMARK_TEMPLATE(BM_FixedCheckFinished, 9);
+BENCHMARK_TEMPLATE(BM_FixedCheckFinished, 15);
+BENCHMARK_TEMPLATE(BM_FixedCheckFinished, 19);
+
+static void BM_CheckFinishedFull(benchmark::State &state)
+{
+    // NOTE: full board scan of a mid-game position (never finished), args: board_size
+    int board_size = state.range(0);
+    auto actions = randomGame(board_size, 5);
+    GobangEnv env(board_size, 5);
+    env.reset();
+    for (size_t i = 0; i < actions.size() / 2; ++i)
+        env.step(actions[i]);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(env.checkFinishedFull());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CheckFinishedFull)->Arg(9)->Arg(15)->Arg(19);
+
+BENCHMARK_MAIN();
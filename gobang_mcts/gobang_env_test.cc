@@ -1,5 +1,8 @@
 #include "envpool/gobang_mcts/gobang_env.hpp"
 
+#include <random>
+#include <algorithm>
+#include <type_traits>
 #include <gtest/gtest.h>
 
 TEST(GobangEnvTest, Basic)
@@ -96,3 +99,286 @@ TEST(GobangEnvTest, Draw)
     EXPECT_EQ(result.first, true);
     EXPECT_EQ(result.second, -1);
 }
+
+TEST(GobangEnvTest, IncrementalCheck)
+{
+    std::mt19937 rng(0);
+    for (int trial = 0; trial < 100; trial++)
+    {
+        GobangEnv env(9, 5);
+        env.reset();
+        while (true)
+        {
+            auto actions = env.getActions();
+            env.step(actions[rng() % actions.size()]);
+            GobangEnv env_full(env);
+            auto result = env.checkFinished();
+            auto result_full = env_full.checkFinishedFull();
+            EXPECT_EQ(result, result_full);
+            if (result.first)
+                break;
+        }
+    }
+}
+
+TEST(GobangEnvTest, LegalActions)
+{
+    std::mt19937 rng(0);
+    GobangEnv env(9, 10);
+    env.reset();
+    for (int i = 0; i < 9 * 9; i++)
+    {
+        auto actions = env.getActions();
+        EXPECT_EQ(actions.size(), 9 * 9 - i);
+        auto stat = env.getStat();
+        std::sort(actions.begin(), actions.end());
+        std::vector<int> expected_actions;
+        for (int j = 0; j < 9 * 9; j++)
+            if (stat.at(j) == -1)
+                expected_actions.push_back(j);
+        EXPECT_EQ(actions, expected_actions);
+        env.step(actions[rng() % actions.size()]);
+    }
+    EXPECT_TRUE(env.getActions().empty());
+}
+
+TEST(GobangEnvTest, Hash)
+{
+    GobangEnv env(9, 5), env_transposed(9, 5), env_rotated(9, 5);
+    env.setCanonicalHash(true);
+    env_rotated.setCanonicalHash(true);
+    for (auto action : {40, 41, 31, 50})
+        env.step(action);
+    for (auto action : {31, 50, 40, 41})
+        env_transposed.step(action);
+    EXPECT_EQ(env.getHash(), env_transposed.getHash());
+
+    // rotated by 90 degrees
+    for (auto action : {40, 41, 31, 50})
+        env_rotated.step(Symmetry::transform(1, action, 9));
+    EXPECT_NE(env.getHash().first, env_rotated.getHash().first);
+    EXPECT_EQ(env.getHash(true).first, env_rotated.getHash(true).first);
+
+    // the history planes only match for the same last moves
+    EXPECT_NE(env.getHash(false, 2).first, env_transposed.getHash(false, 2).first);
+    EXPECT_EQ(env.getHash(true, 2).first, env_rotated.getHash(true, 2).first);
+    for (auto action : {22, 23})
+    {
+        env.step(action);
+        env_transposed.step(action);
+    }
+    EXPECT_EQ(env.getHash(false, 2), env_transposed.getHash(false, 2));
+    EXPECT_NE(env.getHash(false, 4).first, env_transposed.getHash(false, 4).first);
+    EXPECT_NE(env.getHash(false, 2).first, env.getHash().first);
+
+    env.step(0);
+    EXPECT_NE(env.getHash().first, env_transposed.getHash().first);
+    EXPECT_NE(env.getHash(true).first, env_rotated.getHash(true).first);
+}
+
+TEST(GobangEnvTest, CanonicalHash)
+{
+    // NOTE: the symmetry hashes are off by default, enabling them later recomputes them
+    GobangEnv env(9, 5), env_canonical(9, 5);
+    env_canonical.setCanonicalHash(true);
+    for (auto action : {40, 41, 31, 50, 22})
+    {
+        env.step(action);
+        env_canonical.step(action);
+    }
+    env_canonical.undo();
+    env.undo();
+    EXPECT_EQ(env.getHash(), env_canonical.getHash());
+    env.setCanonicalHash(true);
+    EXPECT_EQ(env.getHash(true), env_canonical.getHash(true));
+    EXPECT_EQ(env.getHash(true, 2), env_canonical.getHash(true, 2));
+
+    // the setting is kept by reset()
+    env.reset();
+    env_canonical.reset();
+    env.step(10);
+    env_canonical.step(Symmetry::transform(3, 10, 9));
+    EXPECT_EQ(env.getHash(true).first, env_canonical.getHash(true).first);
+    auto hash = env.getHash();
+    env.setCanonicalHash(false);
+    EXPECT_EQ(env.getHash(), hash);
+}
+
+TEST(GobangEnvTest, EncodeInPlace)
+{
+    // NOTE: compare against replaying the history up to each turn
+    std::mt19937 rng(0);
+    int board_size = 9, num_player_planes = 4;
+    int flatten_size = board_size * board_size;
+    GobangEnv env(board_size, board_size + 1);
+    env.reset();
+    std::vector<int> actions;
+    std::vector<int> buffer(env.stateSize(num_player_planes) + 1, -7);
+    for (int t = 0; t < 40; t++)
+    {
+        env.writeState(num_player_planes, buffer.data());
+        EXPECT_EQ(buffer.back(), -7); // no overflow
+        for (int k = 0; k < 2; k++)
+            for (int i = 0; i < num_player_planes; i++)
+            {
+                // stones of player k, 2i moves ago
+                std::vector<int> expected(flatten_size, 0);
+                for (int h = 0; h < static_cast<int>(actions.size()) - 2 * i; h++)
+                    if (h % 2 == k)
+                        expected[actions[h]] = 1;
+                const int *plane = buffer.data() + (k * num_player_planes + i) * flatten_size;
+                EXPECT_EQ(std::vector<int>(plane, plane + flatten_size), expected);
+            }
+        for (int j = 0; j < flatten_size; j++)
+            EXPECT_EQ(buffer[2 * num_player_planes * flatten_size + j], t % 2);
+        auto valid_actions = env.getActions();
+        actions.push_back(valid_actions[rng() % valid_actions.size()]);
+        env.step(actions.back());
+    }
+}
+
+TEST(GobangEnvTest, EncodeCompact)
+{
+    std::mt19937 rng(0);
+    for (int board_size : {3, 8, 15, 19})
+    {
+        int num_player_planes = 3, flatten_size = board_size * board_size;
+        int num_words = (flatten_size + 63) / 64;
+        GobangEnv env(board_size, board_size + 1);
+        env.reset();
+        EXPECT_EQ(env.stateSize(num_player_planes, true), (num_player_planes * 2 + 1) * num_words);
+        for (int t = 0; t < flatten_size; t++)
+        {
+            auto state = env.getState(num_player_planes);
+            std::vector<uint8_t> bytes(env.stateSize(num_player_planes));
+            env.writeState(num_player_planes, bytes.data());
+            EXPECT_EQ(std::vector<int>(bytes.begin(), bytes.end()), state);
+
+            std::vector<uint64_t> words(env.stateSize(num_player_planes, true), ~0ull);
+            env.writeState(num_player_planes, words.data());
+            for (int k = 0; k < num_player_planes * 2 + 1; k++)
+                for (int i = 0; i < num_words * 64; i++)
+                {
+                    int bit = (words[k * num_words + i / 64] >> (i % 64)) & 1;
+                    EXPECT_EQ(bit, i < flatten_size ? state[k * flatten_size + i] : 0);
+                }
+            auto valid_actions = env.getActions();
+            env.step(valid_actions[rng() % valid_actions.size()]);
+        }
+    }
+}
+
+TEST(GobangEnvTest, CandidateActions)
+{
+    std::mt19937 rng(0);
+    for (int radius : {1, 2, 3})
+    {
+        int board_size = 15;
+        GobangEnv env(board_size, board_size + 1, radius);
+        env.reset();
+        EXPECT_EQ(env.getActions(), std::vector<int>{7 * 15 + 7}); // centre
+        for (int t = 0; t < board_size * board_size; t++)
+        {
+            auto actions = env.getActions();
+            std::sort(actions.begin(), actions.end());
+            const auto &board = env.getBoard();
+            std::vector<int> expected_actions;
+            for (int i = 0; i < board_size * board_size && t > 0; i++)
+            {
+                bool near = false;
+                for (int j = 0; j < board_size * board_size; j++)
+                    near |= board.at(j) != -1 &&
+                            std::abs(i / board_size - j / board_size) <= radius &&
+                            std::abs(i % board_size - j % board_size) <= radius;
+                if (board.at(i) == -1 && near)
+                    expected_actions.push_back(i);
+            }
+            if (t > 0)
+            {
+                EXPECT_EQ(actions, expected_actions);
+            }
+            // NOTE: also play moves outside the candidates
+            const auto &legal_actions = board.legal_actions;
+            env.step(t % 4 == 1 ? legal_actions[rng() % legal_actions.size()]
+                                : actions[rng() % actions.size()]);
+        }
+        EXPECT_TRUE(env.getActions().empty());
+    }
+}
+
+TEST(GobangEnvTest, Undo)
+{
+    // NOTE: undo() restores every field of the board, incl. the order of the actions
+    std::mt19937 rng(0);
+    for (int candidate_radius : {0, 1, 2})
+    {
+        GobangBoard board(9, candidate_radius);
+        std::vector<GobangBoard> boards;
+        for (int i = 0; i < 9 * 9; i++)
+        {
+            boards.push_back(board);
+            board.step(board.legal_actions[rng() % board.legal_actions.size()]);
+        }
+        for (int i = 9 * 9 - 1; i >= 0; i--)
+        {
+            board.undo();
+            const auto &expected = boards[i];
+            EXPECT_EQ(board.stones[0].rows, expected.stones[0].rows);
+            EXPECT_EQ(board.stones[1].rows, expected.stones[1].rows);
+            EXPECT_EQ(board.player, expected.player);
+            EXPECT_EQ(board.historical_actions, expected.historical_actions);
+            EXPECT_EQ(board.hashes, expected.hashes);
+            EXPECT_EQ(board.legal_actions, expected.legal_actions);
+            EXPECT_EQ(board.legal_positions, expected.legal_positions);
+            EXPECT_EQ(board.candidate_actions, expected.candidate_actions);
+            EXPECT_EQ(board.candidate_positions, expected.candidate_positions);
+            EXPECT_EQ(board.neighbour_counts, expected.neighbour_counts);
+        }
+    }
+
+    // NOTE: a finished game is not finished after the winning move is undone
+    GobangEnv env(9, 5);
+    env.reset();
+    for (auto action : {0, 9, 1, 10, 2, 11, 3, 12, 4})
+        env.step(action);
+    EXPECT_EQ(env.checkFinished(), std::make_pair(true, 0));
+    env.undo();
+    EXPECT_EQ(env.checkFinished(), std::make_pair(false, -1));
+}
+
+TEST(GobangEnvTest, FixedSize)
+{
+    // NOTE: the fixed-size board is a drop-in replacement of the dynamic one
+    static_assert(std::is_trivially_copyable<GobangBoardT<15>>::value,
+                  "Fixed-size boards should be trivially copyable");
+    std::mt19937 rng(0);
+    for (int candidate_radius : {0, 2})
+    {
+        GobangEnv env(9, 5, candidate_radius);
+        GobangEnvT<9, 5> fixed_env(9, 5, candidate_radius);
+        env.setCanonicalHash(true);
+        fixed_env.setCanonicalHash(true);
+        env.reset();
+        fixed_env.reset();
+        std::vector<int> state(env.stateSize(4)), fixed_state(env.stateSize(4));
+        while (true)
+        {
+            const auto &actions = env.getActions();
+            const auto &fixed_actions = fixed_env.getActions();
+            ASSERT_EQ(actions.size(), fixed_actions.size());
+            EXPECT_TRUE(std::equal(actions.begin(), actions.end(), fixed_actions.begin()));
+            EXPECT_EQ(env.getHash(true), fixed_env.getHash(true));
+            env.writeState(4, state.data());
+            fixed_env.writeState(4, fixed_state.data());
+            EXPECT_EQ(state, fixed_state);
+
+            int action = actions[rng() % actions.size()];
+            env.step(action);
+            fixed_env.step(action);
+            auto result = env.checkFinished();
+            EXPECT_EQ(result, fixed_env.checkFinished());
+            if (result.first)
+                break;
+        }
+    }
+}
@@ -2,7 +2,68 @@
 
 #include "envpool/core/py_envpool.h"
 
+#include <string>
+#include <cstring>
+
+#include <pybind11/numpy.h>
+
 using GobangEnvSpec = PyEnvSpec<GobangSpace::GobangEnvSpec>;
 using GobangEnvPool = PyEnvPool<GobangSpace::GobangEnvPool>;
 
-PYBIND11_MODULE(py_gobang_envpool, m) { REGISTER(m, GobangEnvSpec, GobangEnvPool) }
+namespace py = pybind11;
+
+static py::dict episodeToDict(const TrajectoryQueue::Episode &episode)
+{
+    // NOTE: states: uint8 [L, 2P + 1, ceil(N * N / 64) * 8] (bit-packed, see unpack_state()),
+    //  the visits of move i are (visit_actions, visit_counts)[visit_offsets[i], visit_offsets[i + 1])
+    py::ssize_t length = episode.length();
+    py::ssize_t num_planes = episode.num_player_planes * 2 + 1;
+    py::ssize_t num_bytes = (episode.board_size * episode.board_size + 63) / 64 * 8;
+    py::array_t<uint8_t> states({length, num_planes, num_bytes});
+    std::memcpy(states.mutable_data(), episode.states.data(), episode.states.size() * sizeof(uint64_t));
+    py::array_t<int> visit_actions(episode.visits.size()), visit_counts(episode.visits.size());
+    for (size_t i = 0; i < episode.visits.size(); ++i)
+    {
+        visit_actions.mutable_data()[i] = episode.visits[i].first;
+        visit_counts.mutable_data()[i] = episode.visits[i].second;
+    }
+    py::dict result;
+    result["env_id"] = episode.id;
+    result["board_size"] = episode.board_size;
+    result["winner"] = episode.winner;
+    result["state"] = states;
+    result["player"] = py::array_t<int>(length, episode.players.data());
+    result["action"] = py::array_t<int>(length, episode.actions.data());
+    result["visit_offsets"] = py::array_t<int>(length + 1, episode.visit_offsets.data());
+    result["visit_actions"] = visit_actions;
+    result["visit_counts"] = visit_counts;
+    return result;
+}
+
+PYBIND11_MODULE(py_gobang_envpool, m)
+{
+    REGISTER(m, GobangEnvSpec, GobangEnvPool)
+
+    m.def(
+        "drain_trajectories",
+        [](size_t max_episodes, const std::string &pool)
+        {
+            py::list result;
+            auto queue = TrajectoryQueue::find(pool);
+            if (queue)
+                for (const auto &episode : queue->drain(max_episodes))
+                    result.append(episodeToDict(episode));
+            return result;
+        },
+        py::arg("max_episodes") = 0, py::arg("pool") = "",
+        "Pop the finished episodes of the envs with emit_trajectory and trajectory_pool = pool, oldest first");
+    m.def(
+        "num_dropped_trajectories",
+        [](const std::string &pool)
+        {
+            auto queue = TrajectoryQueue::find(pool);
+            return queue ? queue->numDropped() : 0;
+        },
+        py::arg("pool") = "",
+        "# episodes dropped since the trajectory queue of pool was full");
+}
@@ -4,8 +4,15 @@
 #include "envpool/core/env.h"
 
 #include "envpool/gobang_mcts/utils.hpp"
+#include "envpool/gobang_mcts/symmetry.hpp"
 #include "envpool/gobang_mcts/gobang_selfplay.hpp"
 
+#include <array>
+#include <string>
+#include <numeric>
+#include <variant>
+#include <type_traits>
+
 namespace GobangSpace
 {
     class GobangEnvFns
@@ -17,6 +24,34 @@ namespace GobangSpace
                 "board_size"_.Bind(15), "win_length"_.Bind(5),
                 "num_player_planes"_.Bind(4),
                 "c_puct"_.Bind(1.0), "num_search"_.Bind(1000),
+                "leaves_per_step"_.Bind(1),
+                "use_transposition"_.Bind(false),
+                "canonical_transposition"_.Bind(false),
+                "eval_cache_size"_.Bind(0),
+                "network_id"_.Bind(std::string("")),
+                "memory_budget_mb"_.Bind(0),
+                "huge_pages"_.Bind(false),
+                "state_format"_.Bind(std::string("int32")),
+                "num_augmentations"_.Bind(0),
+                "evaluator"_.Bind(std::string("network")),
+                "num_rollouts"_.Bind(1),
+                "candidate_radius"_.Bind(0),
+                "sample_moves"_.Bind(false),
+                "temperature"_.Bind(1.0),
+                "temperature_moves"_.Bind(30),
+                "final_temperature"_.Bind(0.0),
+                "dirichlet_alpha"_.Bind(0.0),
+                "dirichlet_epsilon"_.Bind(0.25),
+                "emit_trajectory"_.Bind(false),
+                "trajectory_queue_size"_.Bind(1 << 12),
+                "trajectory_pool"_.Bind(std::string("")),
+                "replay_path"_.Bind(std::string("")),
+                "replay_max_actions"_.Bind(0),
+                "replay_shard_size"_.Bind(1 << 16),
+                "instrumentation"_.Bind(false),
+                "full_search_prob"_.Bind(1.0),
+                "num_search_fast"_.Bind(100),
+                "early_stop"_.Bind(false),
                 "delay_epsilon"_.Bind(0.0),
                 "verbose_output"_.Bind(false));
             // Why do we need delay_epsilon?
@@ -24,16 +59,114 @@ namespace GobangSpace
             //  the 1st policy need ~ 400 / 128 * (40 - 1) * 100 ~ 12,000 steps to collect the first 10 episode
             //  however, the 2nd policy only need ~ 400 / 128 * 1 * 100 ~ 300 steps to collect the next 10 episode
             //  thus, this would cause unbalanced # sample
+            // NOTE: with leaves_per_step = K > 1, each step emits up to K leaves,
+            //  obs:state becomes [K, ...] and prior_probs / value become [K, ...] / [K]
+            // NOTE: eval_cache_size > 0 enables a process-wide cache of evaluations,
+            //  bump model_version in the action whenever the network is updated.
+            //  Cache & transposition keys include the moves on the history planes (num_player_planes > 1)
+            //  envs share a cache only if they share eval_cache_size, board_size, num_player_planes
+            //  and network_id, give each network a distinct network_id when several pools run side by side
+            // NOTE: memory_budget_mb > 0 bounds the search trees of each env,
+            //  expansions beyond the budget are refused (see info:peak_nodes),
+            //  it must be at least 4 (8 with huge_pages), the first chunks of the trees of both players.
+            //  The transposition table and the scratch of tree reuse are not counted
+            //  huge_pages backs the trees with transparent huge pages
+            // NOTE: state_format = "uint8" / "bits" moves the states to obs:state_compact,
+            //  with uint8 planes or bit-packed planes (ceil(N * N / 64) little-endian uint64 per plane),
+            //  obs:state is left empty, see unpack_state() in the python package
+            // NOTE: num_augmentations = A > 0 emits A of the 8 dihedral transforms (all if A = 8,
+            //  a random subset otherwise) of the training sample when info:is_player_done,
+            //  obs:augmented_state [A, 2P + 1, N, N] (uint8), obs:augmented_mcts_result [A, N * N]
+            //  and info:symmetries [A], see Symmetry::transform() for the symmetry ids
+            // NOTE: evaluator = "rollout" / "heuristic" evaluates the leaves in C++
+            //  (see RolloutEvaluator), each step then finishes the search of a whole move
+            //  and prior_probs / value in the action are ignored
+            // NOTE: candidate_radius = r > 0 only expands the empty cells within r of a stone
+            //  (the centre on an empty board), other moves are reported as -1 in obs:mcts_result
+            // NOTE: sample_moves samples each move in C++ from the visit counts (N^(1 / temperature)
+            //  for the first temperature_moves moves, final_temperature afterwards, 0 being greedy)
+            //  as soon as its search is done, selected_action is ignored. The step that plays a move
+            //  reports it in info:sampled_action (-1 otherwise) with its training sample in
+            //  obs:sampled_state (uint8) & obs:mcts_result, obs:state holds the leaves of the next move
+            // NOTE: dirichlet_alpha > 0 mixes Dir(alpha) noise into the root priors,
+            //  weighted by dirichlet_epsilon, noise & sampling are seeded per env
+            // NOTE: emit_trajectory buffers the episode in C++ and pushes it to the process-wide queue
+            //  of trajectory_pool when done (see TrajectoryQueue), drain it with
+            //  drain_trajectories(pool=trajectory_pool) of the python package,
+            //  give each pool a distinct trajectory_pool when several pools run side by side.
+            //  The trajectory is never part of the state, which is allocated on every step,
+            //  info:trajectory_length is the # moves of the pushed episode (0 otherwise),
+            //  the latest trajectory_queue_size episodes are kept (the same for all envs of a pool)
+            // NOTE: replay_path = prefix appends finished games to the memory-mapped shards
+            //  <prefix>-<index>.bin (see ReplayWriter), replay_shard_size records per shard,
+            //  the replay_max_actions most visited actions per record (0 for all),
+            //  read them with ReplayReader in the python package
+            // NOTE: instrumentation publishes the cumulative counters of the episode,
+            //  info:search_counters [simulations, leaves, terminal hits, nodes, edges, pruned] and
+            //  info:phase_ns [select, terminal, expand, backprop, evaluate, encode, wait],
+            //  phase timers are only compiled in with -DGOBANG_PROFILE (0 otherwise), see Profile
+            // NOTE: full_search_prob = p < 1 enables playout cap randomisation, each move is searched
+            //  with num_search with probability p, with num_search_fast otherwise.
+            //  info:is_full_search tells whether the move of obs:mcts_result (or info:sampled_action)
+            //  is a training sample, fast moves are never part of trajectories & replays
+            // NOTE: early_stop ends a search once its most visited root child can no longer be
+            //  overtaken, info:pruned_simulations is the # skipped simulations of the reported move
         }
 
         template <typename Config>
         static decltype(auto) StateSpec(const Config &conf)
         {
+            int num_planes = conf["num_player_planes"_] * 2 + 1;
+            int flatten_size = conf["board_size"_] * conf["board_size"_];
+            std::string state_format = conf["state_format"_];
+            std::vector<int> state_shape{num_planes, conf["board_size"_], conf["board_size"_]};
+            std::vector<int> compact_shape{0};
+            if (state_format == "uint8")
+                compact_shape = state_shape;
+            else if (state_format == "bits")
+                compact_shape = {num_planes, (flatten_size + 63) / 64 * 8};
+            if (state_format != "int32")
+                state_shape = {0};
+            for (auto *shape : {&state_shape, &compact_shape})
+                if (conf["leaves_per_step"_] > 1 && shape->size() > 1)
+                    shape->insert(shape->begin(), conf["leaves_per_step"_]);
+            int num_augmentations = conf["num_augmentations"_];
+            std::vector<int> augmented_state_shape{0}, augmented_result_shape{0}, symmetries_shape{0};
+            if (num_augmentations > 0)
+            {
+                augmented_state_shape = {num_augmentations, num_planes,
+                                         conf["board_size"_], conf["board_size"_]};
+                augmented_result_shape = {num_augmentations, flatten_size};
+                symmetries_shape = {num_augmentations};
+            }
+            std::vector<int> counters_shape{0}, phases_shape{0};
+            if (conf["instrumentation"_])
+            {
+                counters_shape = {Profile::SearchCounters::NUM_COUNTERS};
+                phases_shape = {Profile::NUM_PHASES};
+            }
+            std::vector<int> sampled_state_shape{0};
+            if (conf["sample_moves"_])
+                sampled_state_shape = {num_planes, conf["board_size"_], conf["board_size"_]};
             return MakeDict(
-                "obs:state"_.Bind(Spec<int>({conf["num_player_planes"_] * 2 + 1,
-                                             conf["board_size"_], conf["board_size"_]})),
+                "obs:state"_.Bind(Spec<int>(std::move(state_shape))),
+                "obs:state_compact"_.Bind(Spec<uint8_t>(std::move(compact_shape))),
                 "obs:mcts_result"_.Bind(Spec<int>({conf["board_size"_] * conf["board_size"_]})),
+                "obs:augmented_state"_.Bind(Spec<uint8_t>(std::move(augmented_state_shape))),
+                "obs:augmented_mcts_result"_.Bind(Spec<int>(std::move(augmented_result_shape))),
+                "info:symmetries"_.Bind(Spec<int>(std::move(symmetries_shape))),
+                "obs:sampled_state"_.Bind(Spec<uint8_t>(std::move(sampled_state_shape))),
+                "info:sampled_action"_.Bind(Spec<int>({})),
+                "info:trajectory_length"_.Bind(Spec<int>({})),
+                "info:search_counters"_.Bind(Spec<int64_t>(std::move(counters_shape))),
+                "info:phase_ns"_.Bind(Spec<int64_t>(std::move(phases_shape))),
                 "info:is_player_done"_.Bind(Spec<bool>({})),
+                "info:is_full_search"_.Bind(Spec<bool>({})),
+                "info:pruned_simulations"_.Bind(Spec<int>({})),
+                "info:num_leaves"_.Bind(Spec<int>({})),
+                "info:cache_hits"_.Bind(Spec<int>({})),
+                "info:cache_misses"_.Bind(Spec<int>({})),
+                "info:peak_nodes"_.Bind(Spec<int>({})),
                 "info:player_step_count"_.Bind(Spec<int>({})),
                 "info:winner"_.Bind(Spec<int>({})));
         }
@@ -41,9 +174,18 @@ namespace GobangSpace
         template <typename Config>
         static decltype(auto) ActionSpec(const Config &conf)
         {
+            std::vector<int> prior_probs_shape{conf["board_size"_] * conf["board_size"_]};
+            std::vector<int> value_shape;
+            if (conf["leaves_per_step"_] > 1)
+            {
+                prior_probs_shape.insert(prior_probs_shape.begin(), conf["leaves_per_step"_]);
+                value_shape.push_back(conf["leaves_per_step"_]);
+            }
             return MakeDict(
-                "prior_probs"_.Bind(Spec<float>({conf["board_size"_] * conf["board_size"_]})),
-                "value"_.Bind(Spec<float>({})), "selected_action"_.Bind(Spec<int>({})));
+                "prior_probs"_.Bind(Spec<float>(std::move(prior_probs_shape))),
+                "value"_.Bind(Spec<float>(std::move(value_shape))),
+                "selected_action"_.Bind(Spec<int>({})),
+                "model_version"_.Bind(Spec<int>({})));
         }
     };
 
@@ -56,8 +198,38 @@ namespace GobangSpace
         int num_player_planes;
         float c_puct;
         int num_search;
+        int leaves_per_step;
+        bool use_transposition, canonical_transposition;
+        size_t memory_budget;
+        bool huge_pages;
+        std::string state_format;
+        int num_augmentations;
+        std::string evaluator;
+        int num_rollouts;
+        int candidate_radius;
+        bool sample_moves;
+        float temperature, final_temperature;
+        int temperature_moves;
+        float dirichlet_alpha, dirichlet_epsilon;
+        bool emit_trajectory;
+        std::shared_ptr<TrajectoryQueue> trajectory_queue;
+        std::shared_ptr<ReplayWriter> replay_writer;
+        bool instrumentation;
+        float full_search_prob;
+        int num_search_fast;
+        bool early_stop;
+        uint64_t wait_start, wait_ticks;
+        std::vector<uint8_t> training_state;
+        std::array<int, Symmetry::NUM_SYMMETRIES> symmetries;
 
-        std::shared_ptr<GobangSelfPlay> game;
+        // NOTE: compile-time boards only where they pay off (see BM_FixedSearch in mcts_benchmark.cc),
+        //  i.e., 15 x 15 and 19 x 19 with win_length 5, the dynamic board otherwise,
+        //  chosen once by makeGame(). Each alternative instantiates the whole selfplay stack
+        std::variant<std::shared_ptr<GobangSelfPlay>,
+                     std::shared_ptr<GobangSelfPlayT<15, 5>>,
+                     std::shared_ptr<GobangSelfPlayT<19, 5>>>
+            game;
+        std::shared_ptr<EvalCache> eval_cache;
         bool done;
 
         // delay
@@ -68,45 +240,195 @@ namespace GobangSpace
         bool verbose_output;
 
     private:
-        void writeState()
+        template <typename T, typename Game>
+        void writeState(Game &game, void *data)
+        {
+            // NOTE: the encoder writes straight into the buffer,
+            //  zero padding when fewer than leaves_per_step leaves are pending
+            T *state_data = reinterpret_cast<T *>(data);
+            int state_size = (num_player_planes * 2 + 1) *
+                             (std::is_same<T, uint64_t>::value
+                                  ? (board_size * board_size + 63) / 64
+                                  : board_size * board_size);
+            int num_states = game.writeState(state_data);
+            std::fill(state_data + num_states * state_size,
+                      state_data + leaves_per_step * state_size, 0);
+        }
+
+        template <typename Game>
+        void writeAugmentations(Game &game, State &state, const std::vector<int> &mcts_result)
+        {
+            // NOTE: a random subset of symmetries (partial Fisher-Yates),
+            //  the training state & visit counts are permuted with the precomputed tables
+            int num_planes = num_player_planes * 2 + 1, flatten_size = board_size * board_size;
+            const uint8_t *training_data = training_state.data();
+            if (sample_moves)
+                training_data = game.getSampledState().data();
+            else
+                game.writeState(training_state.data());
+            auto *state_data = reinterpret_cast<uint8_t *>(state["obs:augmented_state"_].Data());
+            auto *result_data = reinterpret_cast<int *>(state["obs:augmented_mcts_result"_].Data());
+            auto *symmetries_data = reinterpret_cast<int *>(state["info:symmetries"_].Data());
+            for (int i = 0; i < num_augmentations; ++i)
+            {
+                if (num_augmentations < Symmetry::NUM_SYMMETRIES)
+                    std::swap(symmetries[i], symmetries[i + gen_() % (Symmetry::NUM_SYMMETRIES - i)]);
+                symmetries_data[i] = symmetries[i];
+                Symmetry::transformPlanes(symmetries[i], board_size, num_planes, training_data,
+                                          state_data + i * num_planes * flatten_size);
+                Symmetry::transformPlanes(symmetries[i], board_size, 1, mcts_result.data(),
+                                          result_data + i * flatten_size);
+            }
+        }
+
+        template <typename Game>
+        void writeCounters(Game &game, State &state)
+        {
+            auto counters = game.getCounters();
+            counters.ticks[Profile::WAIT] = wait_ticks;
+            counters.writeCounters(reinterpret_cast<int64_t *>(state["info:search_counters"_].Data()));
+            counters.writeNanoseconds(reinterpret_cast<int64_t *>(state["info:phase_ns"_].Data()));
+        }
+
+        template <typename Game>
+        void writeState(Game &game)
         {
             State state = Allocate();
-            auto state_ = game->getState();
-            int *state_data = reinterpret_cast<int *>(state["obs:state"_].Data());
-            std::copy(state_.begin(), state_.end(), state_data);
+            if (state_format == "uint8")
+                writeState<uint8_t>(game, state["obs:state_compact"_].Data());
+            else if (state_format == "bits")
+                writeState<uint64_t>(game, state["obs:state_compact"_].Data());
+            else
+                writeState<int>(game, state["obs:state"_].Data());
+            state["info:num_leaves"_] = game.numLeaves();
+            state["info:cache_hits"_] = game.numCacheHits();
+            state["info:cache_misses"_] = game.numCacheMisses();
+            state["info:peak_nodes"_] = game.peakNodes();
             // for (int index = 0, k = 0; k < num_player_planes * 2 + 1; ++k)
             //     for (int i = 0; i < board_size; i++)
             //         for (int j = 0; j < board_size; j++, index++)
             //             state["obs:state"_](k, i, j) = state_[index];
 
-            bool is_player_done = game->isPlayerDone();
-            if (is_player_done)
+            // NOTE: with sample_moves, the training sample is the move played by this step
+            bool is_player_done = game.isPlayerDone();
+            int sampled_action = game.sampledAction();
+            bool is_move_done = sample_moves ? sampled_action != -1 : is_player_done;
+            if (is_move_done)
             {
-                auto mcts_result_ = game->getSearchResult();
+                auto mcts_result_ = sample_moves ? game.getSampledResult() : game.getSearchResult();
                 int *mcts_result_data = reinterpret_cast<int *>(state["obs:mcts_result"_].Data());
                 std::copy(mcts_result_.begin(), mcts_result_.end(), mcts_result_data);
+                if (sample_moves)
+                {
+                    const auto &sampled_state = game.getSampledState();
+                    std::copy(sampled_state.begin(), sampled_state.end(),
+                              reinterpret_cast<uint8_t *>(state["obs:sampled_state"_].Data()));
+                }
+                if (num_augmentations > 0)
+                    writeAugmentations(game, state, mcts_result_);
             }
             state["info:is_player_done"_] = is_player_done;
-            state["info:winner"_] = done ? game->getWinner() : -1;
+            state["info:is_full_search"_] = sample_moves ? game.sampledFullSearch() : game.isFullSearch();
+            state["info:pruned_simulations"_] = sample_moves ? game.sampledPrunedSimulations()
+                                                             : game.prunedSimulations();
+            state["info:sampled_action"_] = sampled_action;
+            state["info:winner"_] = done ? game.getWinner() : -1;
+            state["info:trajectory_length"_] = emit_trajectory && done ? game.trajectoryLength() : 0;
+            if (instrumentation)
+                writeCounters(game, state);
+            // NOTE: the time until the next step is spent waiting on python
+            wait_start = Profile::now();
 
             // debug
-            if (is_player_done)
+            if (is_move_done)
                 player_step_count++;
             state["info:player_step_count"_] = player_step_count;
             if (done)
             {
-                assertMsg(player_step_count == game->historical_actions.size(),
+                assertMsg(player_step_count == game.historical_actions.size(),
                           "Player step count should be equal to historical actions size");
                 if (verbose_output)
                 {
                     std::cout << "Player step count: " << player_step_count << std::endl;
                     std::cout << "Env id: " << env_id_ << std::endl;
-                    game->display();
+                    game.display();
                     std::cout << std::endl;
                 }
             }
         }
 
+        template <int N, int K>
+        void makeGame()
+        {
+            game = std::make_shared<GobangSelfPlayT<N, K>>(
+                board_size, win_length, num_player_planes,
+                c_puct, num_search, leaves_per_step,
+                use_transposition, canonical_transposition,
+                memory_budget, huge_pages, candidate_radius);
+        }
+
+        void makeGame()
+        {
+            if (board_size == 15 && win_length == 5)
+                makeGame<15, 5>();
+            else if (board_size == 19 && win_length == 5)
+                makeGame<19, 5>();
+            else
+                makeGame<0, 0>();
+        }
+
+        template <typename Game>
+        void setupGame(Game &game)
+        {
+            // NOTE: called once, the game, its players & buffers are reused by every episode
+            if (eval_cache)
+                game.setEvalCache(eval_cache);
+            if (evaluator != "network")
+                game.setEvaluator(std::make_shared<typename Game::RolloutEvaluator>(
+                    board_size, win_length, num_rollouts, evaluator == "heuristic", gen_()));
+            if (sample_moves)
+                game.setMoveSampling(temperature, temperature_moves, final_temperature);
+            game.setRootNoise(dirichlet_alpha, dirichlet_epsilon);
+            if (trajectory_queue)
+                game.setTrajectoryQueue(trajectory_queue, env_id_);
+            if (replay_writer)
+                game.setReplayWriter(replay_writer);
+            game.setEarlyStop(early_stop);
+            if (full_search_prob < 1)
+                game.setPlayoutCap(full_search_prob, num_search_fast);
+        }
+
+        template <typename Game>
+        void resetGame(Game &game)
+        {
+            game.seed(gen_());
+            game.reset();
+        }
+
+        template <typename Game>
+        void stepGame(Game &game, const Action &action)
+        {
+            if (verbose_output && game.isPlayerDone() && !sample_moves)
+            {
+                std::cout << "Env: " << env_id_
+                          << " step: " << static_cast<int>(action["selected_action"_]) << std::endl;
+            }
+            // NOTE: prior_probs & values are only read for the pending leaves,
+            //  i.e., they are of no use when the player is done
+            auto *prior_probs_data = reinterpret_cast<const float *>(action["prior_probs"_].Data());
+            auto *values_data = reinterpret_cast<const float *>(action["value"_].Data());
+            game.setModelVersion(action["model_version"_]);
+            done = game.step(prior_probs_data, values_data,
+                             action["selected_action"_]);
+        }
+
+        void writeState()
+        {
+            std::visit([this](auto &game)
+                       { writeState(*game); },
+                       game);
+        }
+
     public:
         GobangEnv(const Spec &spec, int env_id)
             : Env<GobangEnvSpec>(spec, env_id),
@@ -115,9 +437,55 @@ namespace GobangSpace
               num_player_planes(spec.config["num_player_planes"_]),
               c_puct(spec.config["c_puct"_]),
               num_search(spec.config["num_search"_]),
+              leaves_per_step(spec.config["leaves_per_step"_]),
+              use_transposition(spec.config["use_transposition"_]),
+              canonical_transposition(spec.config["canonical_transposition"_]),
+              memory_budget(static_cast<size_t>(spec.config["memory_budget_mb"_]) << 20),
+              huge_pages(spec.config["huge_pages"_]),
+              state_format(spec.config["state_format"_]),
+              num_augmentations(spec.config["num_augmentations"_]),
+              evaluator(spec.config["evaluator"_]),
+              num_rollouts(spec.config["num_rollouts"_]),
+              candidate_radius(spec.config["candidate_radius"_]),
+              sample_moves(spec.config["sample_moves"_]),
+              temperature(spec.config["temperature"_]),
+              final_temperature(spec.config["final_temperature"_]),
+              temperature_moves(spec.config["temperature_moves"_]),
+              dirichlet_alpha(spec.config["dirichlet_alpha"_]),
+              dirichlet_epsilon(spec.config["dirichlet_epsilon"_]),
+              emit_trajectory(spec.config["emit_trajectory"_]),
+              instrumentation(spec.config["instrumentation"_]),
+              full_search_prob(spec.config["full_search_prob"_]),
+              num_search_fast(spec.config["num_search_fast"_]),
+              early_stop(spec.config["early_stop"_]),
+              wait_start(0), wait_ticks(0),
               delay_steps(spec.config["delay_epsilon"_] * env_id),
               verbose_output(spec.config["verbose_output"_])
         {
+            assertMsg(state_format == "int32" || state_format == "uint8" || state_format == "bits",
+                      "state_format must be int32, uint8 or bits");
+            assertMsg(num_augmentations >= 0 && num_augmentations <= Symmetry::NUM_SYMMETRIES,
+                      "num_augmentations must be in [0, 8]");
+            assertMsg(evaluator == "network" || evaluator == "rollout" || evaluator == "heuristic",
+                      "evaluator must be network, rollout or heuristic");
+            training_state.resize((num_player_planes * 2 + 1) * board_size * board_size);
+            std::iota(symmetries.begin(), symmetries.end(), 0);
+            std::string replay_path = spec.config["replay_path"_];
+            if (!replay_path.empty())
+                replay_writer = ReplayWriter::shared(replay_path, board_size, num_player_planes,
+                                                     spec.config["replay_max_actions"_],
+                                                     spec.config["replay_shard_size"_]);
+            if (emit_trajectory)
+                trajectory_queue = TrajectoryQueue::shared(spec.config["trajectory_pool"_],
+                                                           spec.config["trajectory_queue_size"_]);
+            if (spec.config["eval_cache_size"_] > 0)
+                eval_cache = EvalCache::shared(spec.config["eval_cache_size"_],
+                                               board_size * board_size, num_player_planes,
+                                               spec.config["network_id"_]);
+            makeGame();
+            std::visit([this](auto &game)
+                       { setupGame(*game); },
+                       game);
             if (verbose_output)
             {
                 std::cout << "Env: " << env_id_
@@ -132,12 +500,12 @@ namespace GobangSpace
 
         void Reset() override
         {
-            game = std::make_shared<GobangSelfPlay>(
-                board_size, win_length, num_player_planes,
-                c_puct, num_search);
-            game->reset();
+            std::visit([this](auto &game)
+                       { resetGame(*game); },
+                       game);
             done = false;
             player_step_count = 0;
+            wait_ticks = 0;
             writeState();
             if (verbose_output)
             {
@@ -147,6 +515,7 @@ namespace GobangSpace
 
         void Step(const Action &action) override
         {
+            Profile::record(wait_ticks, wait_start);
             if (delay_steps > 0)
             {
                 delay_steps--;
@@ -159,21 +528,9 @@ namespace GobangSpace
                 return;
             }
 
-            if (verbose_output && game->isPlayerDone())
-            {
-                std::cout << "Env: " << env_id_
-                          << " step: " << static_cast<int>(action["selected_action"_]) << std::endl;
-            }
-            std::vector<float> prior_probs;
-            if (!game->isPlayerDone())
-            {
-                // NOTE: prior_probs & values are of no use when mcts is not done
-                prior_probs.resize(board_size * board_size);
-                float *prior_probs_data = reinterpret_cast<float *>(action["prior_probs"_].Data());
-                std::copy(prior_probs_data, prior_probs_data + prior_probs.size(), prior_probs.begin());
-            }
-            done = game->step(prior_probs, action["value"_],
-                              action["selected_action"_]);
+            std::visit([this, &action](auto &game)
+                       { stepGame(*game, action); },
+                       game);
             writeState();
         }
     };
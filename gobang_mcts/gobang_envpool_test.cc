@@ -59,7 +59,8 @@ TEST(GobangEnvPoolTest, Single)
                                        Array(Spec<int>({batch_size})),
                                        Array(Spec<float>({batch_size, 3 * 3})),
                                        Array(Spec<float>({batch_size})),
-                                       Array(Spec<float>({batch_size}))});
+                                       Array(Spec<int>({batch_size})),
+                                       Array(Spec<int>({batch_size}))});
         GobangAction action(&raw_action);
         // auto action_keys = action.StaticKeys();
         auto env_id = state["info:env_id"_];
@@ -70,6 +71,7 @@ TEST(GobangEnvPoolTest, Single)
                 action["prior_probs"_][i][j] = .1f;
             action["value"_][i] = 0;
             action["selected_action"_][i] = best_action;
+            action["model_version"_][i] = 0;
         }
         envpool.Send(action);
 
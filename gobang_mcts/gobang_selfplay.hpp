@@ -3,17 +3,29 @@
 #include "envpool/gobang_mcts/utils.hpp"
 #include "envpool/gobang_mcts/mcts.hpp"
 #include "envpool/gobang_mcts/gobang_env.hpp"
+#include "envpool/gobang_mcts/eval_cache.hpp"
+#include "envpool/gobang_mcts/evaluator.hpp"
+#include "envpool/gobang_mcts/replay_buffer.hpp"
+#include "envpool/gobang_mcts/trajectory_queue.hpp"
 
+#include <cmath>
 #include <tuple>
+#include <random>
 #include <vector>
 #include <numeric>
 #include <algorithm>
 #include <unordered_map>
 
-class GobangSelfPlay
+template <int N = 0, int K = 0>
+class GobangSelfPlayT
 {
+    // NOTE: N & K fix the board size & win length at compile time, see GobangBoardT
+public:
+    using GobangEnv = GobangEnvT<N, K>;
+    using RolloutEvaluator = RolloutEvaluatorT<GobangEnv>;
+
 private:
-    using GobangMCTS = MCTS<GobangEnv, GobangBoard>;
+    using GobangMCTS = MCTS<GobangEnv>;
     static const int NUM_PLAYERS = 2;
 
     // specs
@@ -21,82 +33,379 @@ private:
     int num_player_planes;
     float c_puct;
     int num_search;
+    int leaves_per_step;
+    // playout cap randomisation, full searches with probability full_search_prob
+    float full_search_prob;
+    int num_search_fast;
+    bool early_stop;
+    bool use_transposition, canonical_transposition;
+    size_t memory_budget;
+    bool huge_pages;
 
     // stat
     GobangEnv gobang_env;
     std::vector<std::shared_ptr<GobangMCTS>> players;
     int current_player, winner;
     bool is_player_done, is_game_done;
+    bool is_full_search;
 
     // episode data
     std::vector<std::pair<int, int>> actions_visits;
 
+    // shared network evaluations (optional)
+    std::shared_ptr<EvalCache> eval_cache;
+    int model_version;
+    int num_cache_hits, num_cache_misses;
+    std::vector<float> cached_probs;
+
+    // in-C++ leaf evaluator (optional), replaces the network
+    std::shared_ptr<RolloutEvaluator> evaluator;
+
+    // in-C++ move selection (optional), replaces the selected action
+    bool sample_moves, sampled_full_search;
+    int pruned_simulations, sampled_pruned_simulations;
+    float temperature, final_temperature;
+    int temperature_moves;
+    float dirichlet_alpha, dirichlet_epsilon;
+    std::mt19937 rng;
+    int sampled_action;
+    std::vector<uint8_t> sampled_state;
+    std::vector<int> sampled_visits;
+    std::vector<double> sample_weights;
+
+    // whole-episode trajectory (optional), bit-packed states & sparse visit counts,
+    //  the visits of record i are trajectory_visits[trajectory_offsets[i], trajectory_offsets[i + 1]),
+    //  only moves with a full search are recorded, trajectory_moves are their move numbers
+    bool record_trajectory;
+    std::vector<uint64_t> trajectory_states;
+    std::vector<std::pair<int, int>> trajectory_visits;
+    std::vector<int> trajectory_offsets;
+    std::vector<int> trajectory_players;
+    std::vector<int> trajectory_moves;
+
+    // finished games are appended to the replay shards (optional)
+    std::shared_ptr<ReplayWriter> replay_writer;
+
+    // finished games are pushed to the trajectory queue (optional), tagged with trajectory_id
+    std::shared_ptr<TrajectoryQueue> trajectory_queue;
+    int trajectory_id;
+    std::vector<int> trajectory_actions;
+
+    void recordTrajectory()
+    {
+        // NOTE: buffer the whole episode for the trajectory queue and the replay writer
+        record_trajectory = true;
+        int max_moves = board_size * board_size;
+        trajectory_states.reserve(max_moves * gobang_env.stateSize(num_player_planes, true));
+        trajectory_offsets.reserve(max_moves + 1);
+        trajectory_players.reserve(max_moves);
+        trajectory_moves.reserve(max_moves);
+    }
+
+    void recordMove()
+    {
+        // NOTE: called before the move is played
+        int state_size = gobang_env.stateSize(num_player_planes, true);
+        trajectory_states.resize(trajectory_states.size() + state_size);
+        gobang_env.writeState(num_player_planes, trajectory_states.data() +
+                                                     trajectory_states.size() - state_size);
+        trajectory_visits.insert(trajectory_visits.end(), actions_visits.begin(), actions_visits.end());
+        trajectory_offsets.push_back(trajectory_visits.size());
+        trajectory_players.push_back(current_player);
+        trajectory_moves.push_back(historical_actions.size());
+    }
+
+    void startMove()
+    {
+        // NOTE: the budget of the next search, full with probability full_search_prob,
+        //  num_search_fast otherwise (the move is then played but not recorded)
+        is_full_search = full_search_prob >= 1 ||
+                         std::uniform_real_distribution<float>(0, 1)(rng) < full_search_prob;
+        players[current_player]->setNumSearch(is_full_search ? num_search : num_search_fast);
+    }
+
+    int sampleAction()
+    {
+        // NOTE: P(a) ~ N(a)^(1 / t), t = temperature for the first temperature_moves moves
+        //  and final_temperature afterwards, t = 0 picks (one of) the most visited actions
+        assertMsg(!actions_visits.empty(), "No action to sample from");
+        float t = static_cast<int>(historical_actions.size()) < temperature_moves ? temperature : final_temperature;
+        int max_visits = 0;
+        for (const auto &action_visit : actions_visits)
+            max_visits = std::max(max_visits, action_visit.second);
+        sample_weights.resize(actions_visits.size());
+        double sum = 0;
+        for (size_t i = 0; i < actions_visits.size(); ++i)
+        {
+            double visits = max_visits > 0 ? static_cast<double>(actions_visits[i].second) / max_visits
+                                           : 1.0;
+            sum += sample_weights[i] = t > 0 ? std::pow(visits, 1.0 / t) : visits == 1.0;
+        }
+        double r = std::uniform_real_distribution<double>(0, sum)(rng);
+        size_t i = 0;
+        while (i + 1 < actions_visits.size() && (r -= sample_weights[i]) >= 0)
+            i++;
+        return actions_visits[i].first;
+    }
+
+    bool resolveCachedLeaves(std::shared_ptr<GobangMCTS> &player)
+    {
+        // NOTE: returns true if all pending leaves are answered by the cache
+        for (int i = player->numPendingLeaves() - 1; i >= 0; --i)
+        {
+            float value;
+            if (!eval_cache->lookup(player->getLeafHash(i), model_version,
+                                    cached_probs.data(), value))
+            {
+                num_cache_misses++;
+                continue;
+            }
+            num_cache_hits++;
+            player->resolveLeaf(i, cached_probs.data(), value);
+        }
+        return player->numPendingLeaves() == 0;
+    }
+
 public:
     std::vector<int> historical_actions; // debug
 
 public:
-    GobangSelfPlay(int board_size, int win_length, int num_player_planes,
-                   float c_puct, int num_search)
+    GobangSelfPlayT(int board_size, int win_length, int num_player_planes,
+                   float c_puct, int num_search, int leaves_per_step = 1,
+                   bool use_transposition = false, bool canonical_transposition = false,
+                   size_t memory_budget = 0, bool huge_pages = false,
+                   int candidate_radius = 0)
         : board_size(board_size), win_length(win_length),
           num_player_planes(num_player_planes),
           c_puct(c_puct), num_search(num_search),
-          gobang_env(board_size, win_length),
+          leaves_per_step(leaves_per_step),
+          full_search_prob(1), num_search_fast(num_search), early_stop(false),
+          use_transposition(use_transposition),
+          canonical_transposition(canonical_transposition),
+          memory_budget(memory_budget), huge_pages(huge_pages),
+          gobang_env(board_size, win_length, candidate_radius),
           current_player(0), winner(-1),
-          is_player_done(false), is_game_done(false)
+          is_player_done(false), is_game_done(false), is_full_search(true),
+          model_version(0), num_cache_hits(0), num_cache_misses(0),
+          sample_moves(false), sampled_full_search(true),
+          pruned_simulations(0), sampled_pruned_simulations(0), temperature(1), final_temperature(0), temperature_moves(0),
+          dirichlet_alpha(0), dirichlet_epsilon(0), sampled_action(-1),
+          record_trajectory(false), trajectory_id(-1)
+    {
+        assertMsg(memory_budget == 0 || memory_budget / NUM_PLAYERS >= NodeArena::minBytes(huge_pages),
+                  "memory_budget must fit a chunk of nodes & edges per player");
+    }
+
+    void setEvalCache(std::shared_ptr<EvalCache> eval_cache)
+    {
+        this->eval_cache = eval_cache;
+        cached_probs.resize(board_size * board_size);
+    }
+
+    void setEvaluator(std::shared_ptr<RolloutEvaluator> evaluator)
+    {
+        // NOTE: each step then finishes the search of a whole move,
+        //  prior_probs & values of step() are ignored
+        this->evaluator = evaluator;
+    }
+
+    void setMoveSampling(float temperature, int temperature_moves, float final_temperature = 0)
+    {
+        // NOTE: moves are sampled from the visit counts as soon as their search is done,
+        //  the action of step() is ignored, see sampledAction()
+        assertMsg(temperature >= 0 && final_temperature >= 0, "temperature must be non-negative");
+        sample_moves = true;
+        this->temperature = temperature;
+        this->temperature_moves = temperature_moves;
+        this->final_temperature = final_temperature;
+        sampled_state.resize((num_player_planes * 2 + 1) * board_size * board_size);
+    }
+
+    void setPlayoutCap(float full_search_prob, int num_search_fast)
+    {
+        // NOTE: KataGo-style playout cap randomisation
+        assertMsg(full_search_prob >= 0 && full_search_prob <= 1, "full_search_prob must be in [0, 1]");
+        assertMsg(num_search_fast > 0, "num_search_fast must be positive");
+        this->full_search_prob = full_search_prob;
+        this->num_search_fast = num_search_fast;
+    }
+
+    void setEarlyStop(bool early_stop)
+    {
+        // NOTE: applied to the players by the next reset(), see MCTS::setEarlyStop()
+        this->early_stop = early_stop;
+    }
+
+    void setRootNoise(float alpha, float epsilon)
+    {
+        // NOTE: applied to the players by the next reset()
+        dirichlet_alpha = alpha;
+        dirichlet_epsilon = epsilon;
+    }
+
+    void seed(uint32_t seed)
+    {
+        // NOTE: drives move sampling & the root noise of both players
+        rng.seed(seed);
+    }
+
+    void setReplayWriter(std::shared_ptr<ReplayWriter> replay_writer)
+    {
+        // NOTE: the trajectory is recorded and written when the game is done
+        this->replay_writer = replay_writer;
+        recordTrajectory();
+    }
+
+    void setTrajectoryQueue(std::shared_ptr<TrajectoryQueue> trajectory_queue, int id)
+    {
+        // NOTE: the trajectory is recorded and pushed when the game is done, see TrajectoryQueue
+        this->trajectory_queue = trajectory_queue;
+        trajectory_id = id;
+        recordTrajectory();
+        trajectory_actions.reserve(board_size * board_size);
+    }
+
+    void setModelVersion(int model_version)
     {
+        // NOTE: cached evaluations of other model versions are ignored
+        this->model_version = model_version;
     }
 
     void reset()
     {
         gobang_env.reset();
-        players.clear();
-        for (int i = 0; i < NUM_PLAYERS; ++i)
-            players.push_back(std::make_shared<GobangMCTS>(
-                c_puct, num_search, std::make_shared<GobangEnv>(gobang_env)));
+        // NOTE: memory_budget is shared by the trees of both players,
+        //  the players (and the chunks of their trees) are reused by the following games
+        if (players.empty())
+            for (int i = 0; i < NUM_PLAYERS; ++i)
+                players.push_back(std::make_shared<GobangMCTS>(
+                    c_puct, num_search, std::make_shared<GobangEnv>(gobang_env),
+                    leaves_per_step, use_transposition, canonical_transposition,
+                    memory_budget / NUM_PLAYERS, huge_pages));
+        else
+            for (auto &player : players)
+                player->reset(gobang_env);
+        for (auto &player : players)
+        {
+            if (dirichlet_alpha > 0)
+                player->setRootNoise(dirichlet_alpha, dirichlet_epsilon, rng());
+            else
+                player->setRootNoise(0, 0, 0);
+            player->setEarlyStop(early_stop);
+            player->setHashHistory(2 * (num_player_planes - 1));
+        }
         current_player = 0;
+        sampled_action = -1;
+        historical_actions.clear();
+        actions_visits.clear();
+        num_cache_hits = num_cache_misses = 0;
+        pruned_simulations = sampled_pruned_simulations = 0;
+        sampled_full_search = true;
+        trajectory_states.clear();
+        trajectory_visits.clear();
+        trajectory_offsets.assign(1, 0);
+        trajectory_players.clear();
+        trajectory_moves.clear();
+        startMove();
         winner = -1;
         is_player_done = false;
         is_game_done = false;
     }
 
-    bool step(std::vector<float> prior_probs, float value, int action)
+    bool step(const std::vector<float> &prior_probs, float value, int action)
+    {
+        return step(prior_probs.data(), &value, action);
+    }
+
+    bool step(const std::vector<float> &prior_probs,
+              const std::vector<float> &values, int action)
     {
+        return step(prior_probs.data(), values.data(), action);
+    }
+
+    bool step(const float *prior_probs, const float *values, int action)
+    {
+        // NOTE: prior_probs: [numLeaves(), board_size * board_size], values: [numLeaves()]
+        //  with move sampling, a step plays at most one move and then keeps searching
+        //  the next one until its leaves need evaluation
+        sampled_action = -1;
         while (true)
         {
             if (!is_player_done)
             {
                 auto player = players[current_player];
-                auto done = player->search(prior_probs, value);
-                if (!done)
-                    return false;
+                if (evaluator)
+                    player->searchWith(*evaluator);
+                else
+                {
+                    if (eval_cache)
+                        for (int i = 0; i < player->numPendingLeaves(); ++i)
+                            eval_cache->insert(player->getLeafHash(i), model_version,
+                                               prior_probs + i * board_size * board_size, values[i]);
+                    auto done = player->search(prior_probs, values);
+                    // NOTE: keep searching while the cache answers all leaves
+                    while (!done && eval_cache && resolveCachedLeaves(player))
+                        done = player->search(nullptr, nullptr);
+                    if (!done)
+                        return false;
+                }
                 // player->display();
 
                 // update game state
                 // std::cout << "Update game state" << std::endl;
                 actions_visits = player->getResult();
+                pruned_simulations = player->numPrunedSimulations();
                 is_player_done = true;
-                return false;
+                if (!sample_moves || sampled_action != -1)
+                    return false;
+            }
+            if (sample_moves)
+            {
+                // NOTE: the training sample of the sampled move is kept until the next step
+                gobang_env.writeState(num_player_planes, sampled_state.data());
+                sampled_visits = getSearchResult();
+                sampled_full_search = is_full_search;
+                sampled_pruned_simulations = pruned_simulations;
+                action = sampled_action = sampleAction();
             }
+            if (record_trajectory && is_full_search)
+                recordMove();
             actions_visits.clear();
             is_player_done = false;
             historical_actions.push_back(action);
             gobang_env.step(action);
             for (auto &player : players)
             {
-                // HACK: reset root here
-                //  avoid update gobang_env more than once in a single step
-                // player->step(action, true);
-
                 // HACK: is_player_done ensures that gobang_env is updated only once
-                player->step(action, true);
+                // NOTE: the subtree of action is reused by each player
+                player->step(action);
             }
             std::tie(is_game_done, winner) = gobang_env.checkFinished();
             assertMsg(winner == -1 || winner == current_player,
                       "Winner is not current player");
             if (is_game_done)
+            {
+                if (replay_writer)
+                    replay_writer->appendGame(trajectoryLength(), trajectory_states.data(),
+                                              trajectory_visits.data(), trajectory_offsets.data(),
+                                              trajectory_players.data(), winner,
+                                              trajectory_moves.data());
+                if (trajectory_queue)
+                {
+                    trajectory_actions.clear();
+                    for (auto move : trajectory_moves)
+                        trajectory_actions.push_back(historical_actions[move]);
+                    trajectory_queue->appendGame(trajectory_id, board_size, num_player_planes,
+                                                 trajectoryLength(), trajectory_states.data(),
+                                                 trajectory_visits.data(), trajectory_offsets.data(),
+                                                 trajectory_players.data(), trajectory_actions.data(),
+                                                 winner);
+                }
                 return true;
+            }
 
             current_player ^= 1;
+            startMove();
         }
     }
 
@@ -111,13 +420,100 @@ public:
         return is_player_done;
     }
 
+    bool isFullSearch() const
+    {
+        // NOTE: whether the search of the current move is a full one
+        return is_full_search;
+    }
+
+    bool sampledFullSearch() const
+    {
+        // NOTE: same as isFullSearch(), for sampledAction()
+        return sampled_full_search;
+    }
+
+    int prunedSimulations() const
+    {
+        // NOTE: simulations skipped by the early stop of the last finished search
+        return pruned_simulations;
+    }
+
+    int sampledPrunedSimulations() const
+    {
+        // NOTE: same as prunedSimulations(), for sampledAction()
+        return sampled_pruned_simulations;
+    }
+
+    int sampledAction() const
+    {
+        // NOTE: the move sampled by the last step, -1 if none
+        return sampled_action;
+    }
+
+    const std::vector<uint8_t> &getSampledState() const
+    {
+        // NOTE: training state [2P + 1, N, N] of sampledAction(), before it was played
+        return sampled_state;
+    }
+
+    const std::vector<int> &getSampledResult() const
+    {
+        // NOTE: same as getSearchResult(), for sampledAction()
+        return sampled_visits;
+    }
+
+    int trajectoryLength() const
+    {
+        return trajectory_players.size();
+    }
+
+    int numCacheHits() const { return num_cache_hits; }
+    int numCacheMisses() const { return num_cache_misses; }
+
+    int peakNodes() const
+    {
+        // NOTE: peak # tree nodes of this episode, summed over players
+        int peak_nodes = 0;
+        for (const auto &player : players)
+            peak_nodes += player->peakNodes();
+        return peak_nodes;
+    }
+
+    Profile::SearchCounters getCounters() const
+    {
+        // NOTE: summed over players, cumulative over this episode
+        Profile::SearchCounters counters;
+        for (const auto &player : players)
+            counters += player->getCounters();
+        return counters;
+    }
+
+    int numLeaves()
+    {
+        // NOTE: # states returned by getState() that need evaluation
+        return is_player_done ? 0 : players[current_player]->numPendingLeaves();
+    }
+
     std::vector<int> getState()
     {
-        if (!is_player_done) // for inference
+        if (!is_player_done) // for inference, [numLeaves(), ...]
             return players[current_player]->getState(num_player_planes);
         return gobang_env.getState(num_player_planes); // for training
     }
 
+    template <typename T>
+    int writeState(T *output)
+    {
+        // NOTE: same as getState(), but written in place, returns # states written
+        if (!is_player_done)
+        {
+            players[current_player]->writeState(num_player_planes, output);
+            return std::max(numLeaves(), 1);
+        }
+        gobang_env.writeState(num_player_planes, output);
+        return 1;
+    }
+
     std::vector<int> getSearchResult()
     {
         // NOTE: use -1 to indicate invalid action
@@ -137,4 +533,6 @@ public:
             std::cout << action << " ";
         std::cout << std::endl;
     }
-};
\ No newline at end of file
+};
+
+using GobangSelfPlay = GobangSelfPlayT<>;
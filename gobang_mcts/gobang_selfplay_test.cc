@@ -1,6 +1,7 @@
 #include "envpool/gobang_mcts/gobang_selfplay.hpp"
 
 #include <numeric>
+#include <algorithm>
 #include <gtest/gtest.h>
 
 TEST(GobangSelfPlayTest, Small)
@@ -13,7 +14,7 @@ TEST(GobangSelfPlayTest, Small)
     bool done = game.step({}, 0, 0);
     EXPECT_FALSE(done);
 
-    int best_action;
+    int best_action = -1;
     bool display_next = false;
     while (!done)
     {
@@ -36,7 +37,7 @@ TEST(GobangSelfPlayTest, Small)
         {
             auto mcts_result = game.getSearchResult();
             int visit_count = 0;
-            for (int i = 0; i < mcts_result.size(); i++)
+            for (int i = 0; i < static_cast<int>(mcts_result.size()); i++)
             {
                 if (mcts_result[i] > visit_count)
                 {
@@ -56,3 +57,351 @@ TEST(GobangSelfPlayTest, Small)
     auto winner = game.getWinner();
     EXPECT_TRUE(winner == -1); // when num_search is large enough
 }
+
+TEST(GobangSelfPlayTest, EvalCache)
+{
+    // NOTE: the 2nd game replays the 1st one, thus all its leaves are cached
+    int num_search = 200;
+    auto eval_cache = EvalCache::shared(100000, 5 * 5, 2);
+    std::vector<int> cache_hits;
+    for (int game_id = 0; game_id < 2; ++game_id)
+    {
+        GobangSelfPlay game(5, 4, 2, 1.0f, num_search);
+        game.setEvalCache(eval_cache);
+        game.reset();
+        std::vector<float> prior_probs(5 * 5, .1f);
+        int best_action = 0, num_steps = 0;
+        bool done = game.step({}, 0, 0);
+        while (!done)
+        {
+            done = game.step(prior_probs, 0.0f, best_action);
+            num_steps++;
+            if (game.isPlayerDone())
+            {
+                auto mcts_result = game.getSearchResult();
+                best_action = std::max_element(mcts_result.begin(), mcts_result.end()) -
+                              mcts_result.begin();
+            }
+        }
+        cache_hits.push_back(game.numCacheHits());
+        if (game_id == 1)
+        {
+            EXPECT_EQ(game.numCacheMisses(), 0);
+        }
+    }
+    EXPECT_GT(cache_hits[1], cache_hits[0]);
+    EXPECT_GT(eval_cache->hitRate(), 0);
+    EXPECT_EQ(EvalCache::shared(100000, 5 * 5, 2), eval_cache);
+    EXPECT_NE(EvalCache::shared(100000, 5 * 5, 1), eval_cache);
+    EXPECT_NE(EvalCache::shared(100000, 5 * 5, 2, "other"), eval_cache);
+}
+
+TEST(GobangSelfPlayTest, RolloutEvaluator)
+{
+    // NOTE: each step finishes a whole move without any network evaluation
+    int board_size = 9;
+    GobangSelfPlay game(board_size, 5, 2, 1.0f, 200);
+    game.setEvaluator(std::make_shared<RolloutEvaluator>(board_size, 5, 1, true, 0));
+    game.reset();
+    int num_moves = 0, action = 0;
+    bool done = false;
+    while (!done)
+    {
+        done = game.step(nullptr, nullptr, action);
+        if (done)
+            break;
+        EXPECT_TRUE(game.isPlayerDone());
+        EXPECT_EQ(game.numLeaves(), 0);
+        auto mcts_result = game.getSearchResult();
+        action = std::max_element(mcts_result.begin(), mcts_result.end()) - mcts_result.begin();
+        num_moves++;
+    }
+    EXPECT_EQ(num_moves, game.historical_actions.size());
+    game.display();
+}
+
+TEST(GobangSelfPlayTest, CandidateRadius)
+{
+    int board_size = 15;
+    GobangSelfPlay game(board_size, 5, 2, 1.0f, 200, 1, false, false, 0, false, 2);
+    game.setEvaluator(std::make_shared<RolloutEvaluator>(board_size, 5, 0, true, 0));
+    game.reset();
+    game.step(nullptr, nullptr, 0);
+    // the first move is searched from the centre only
+    auto mcts_result = game.getSearchResult();
+    EXPECT_EQ(std::count_if(mcts_result.begin(), mcts_result.end(),
+                            [](int visit_count)
+                            { return visit_count >= 0; }),
+              1);
+    int action = std::max_element(mcts_result.begin(), mcts_result.end()) - mcts_result.begin();
+    EXPECT_EQ(action, 7 * 15 + 7);
+    game.step(nullptr, nullptr, action);
+    mcts_result = game.getSearchResult();
+    EXPECT_EQ(std::count_if(mcts_result.begin(), mcts_result.end(),
+                            [](int visit_count)
+                            { return visit_count >= 0; }),
+              5 * 5 - 1);
+}
+
+TEST(GobangSelfPlayTest, SampleMoves)
+{
+    // NOTE: each step plays one sampled move, selected_action is ignored
+    int board_size = 7;
+    std::vector<std::vector<int>> games;
+    for (uint32_t seed : {1u, 1u, 2u})
+    {
+        GobangSelfPlay game(board_size, 4, 2, 1.0f, 100);
+        game.setEvaluator(std::make_shared<RolloutEvaluator>(board_size, 4, 1, true, 0));
+        game.setMoveSampling(1.0f, 4);
+        game.setRootNoise(0.3f, 0.25f);
+        game.seed(seed);
+        game.reset();
+        bool done = false;
+        while (!done)
+        {
+            int num_moves = game.historical_actions.size();
+            done = game.step(nullptr, nullptr, -1);
+            EXPECT_EQ(game.historical_actions.size(), num_moves + 1);
+            int action = game.sampledAction();
+            EXPECT_EQ(action, game.historical_actions.back());
+            const auto &visits = game.getSampledResult();
+            EXPECT_GT(visits[action], 0);
+            // the training state is taken before the move
+            const auto &state = game.getSampledState();
+            EXPECT_EQ(state[action] + state[board_size * board_size * 2 + action], 0);
+            // greedy after temperature_moves
+            if (num_moves >= 4)
+            {
+                EXPECT_EQ(visits[action], *std::max_element(visits.begin(), visits.end()));
+            }
+        }
+        games.push_back(game.historical_actions);
+    }
+    // moves only depend on the seed
+    EXPECT_EQ(games[0], games[1]);
+    EXPECT_NE(games[0], games[2]);
+}
+
+TEST(GobangSelfPlayTest, Trajectory)
+{
+    int board_size = 7, num_player_planes = 2;
+    GobangSelfPlay game(board_size, 4, num_player_planes, 1.0f, 100);
+    game.setEvaluator(std::make_shared<RolloutEvaluator>(board_size, 4, 1, true, 0));
+    auto queue = std::make_shared<TrajectoryQueue>(1);
+    game.setTrajectoryQueue(queue, 0);
+    game.reset();
+    std::vector<std::vector<int>> states, mcts_results;
+    int action = 0;
+    while (!game.step(nullptr, nullptr, action))
+    {
+        states.push_back(game.getState());
+        mcts_results.push_back(game.getSearchResult());
+        action = std::max_element(mcts_results.back().begin(), mcts_results.back().end()) -
+                 mcts_results.back().begin();
+    }
+
+    auto episodes = queue->drain();
+    ASSERT_EQ(episodes.size(), 1);
+    const auto &episode = episodes[0];
+    int length = game.trajectoryLength();
+    EXPECT_EQ(length, states.size());
+    EXPECT_EQ(episode.length(), length);
+    EXPECT_EQ(episode.actions, game.historical_actions);
+    int flatten_size = board_size * board_size;
+    int num_planes = num_player_planes * 2 + 1, num_words = (flatten_size + 63) / 64;
+    for (int i = 0; i < length; ++i)
+    {
+        EXPECT_EQ(episode.players[i], i % 2);
+        std::vector<int> mcts_result(flatten_size, -1);
+        for (int j = episode.visit_offsets[i]; j < episode.visit_offsets[i + 1]; ++j)
+            mcts_result[episode.visits[j].first] = episode.visits[j].second;
+        EXPECT_EQ(mcts_result, mcts_results[i]);
+        for (int k = 0; k < num_planes; ++k)
+            for (int j = 0; j < flatten_size; ++j)
+            {
+                auto word = episode.states[(i * num_planes + k) * num_words + j / 64];
+                EXPECT_EQ(static_cast<int>(word >> (j % 64) & 1), states[i][k * flatten_size + j]);
+            }
+    }
+}
+
+TEST(GobangSelfPlayTest, ReplayWriter)
+{
+    char directory[] = "/tmp/selfplay_replay_XXXXXX";
+    ASSERT_NE(mkdtemp(directory), nullptr);
+    std::string prefix = std::string(directory) + "/games";
+    int board_size = 7;
+    GobangSelfPlay game(board_size, 4, 2, 1.0f, 50);
+    game.setEvaluator(std::make_shared<RolloutEvaluator>(board_size, 4, 1, true, 0));
+    game.setMoveSampling(1.0f, 4);
+    game.setReplayWriter(ReplayWriter::shared(prefix, board_size, 2));
+    game.reset();
+    while (!game.step(nullptr, nullptr, -1))
+        ;
+
+    ReplayReader reader(prefix);
+    EXPECT_EQ(reader.size(), game.historical_actions.size());
+    std::vector<int> visit_counts(board_size * board_size);
+    for (uint64_t i = 0; i < reader.size(); ++i)
+    {
+        EXPECT_EQ(reader.winner(i), game.getWinner());
+        reader.decodeVisits(i, visit_counts.data());
+        EXPECT_GT(visit_counts[game.historical_actions[i]], 0);
+    }
+}
+
+TEST(GobangSelfPlayTest, TrajectoryQueue)
+{
+    int board_size = 7;
+    GobangSelfPlay game(board_size, 4, 2, 1.0f, 50);
+    game.setEvaluator(std::make_shared<RolloutEvaluator>(board_size, 4, 1, true, 0));
+    game.setMoveSampling(1.0f, 4);
+    auto queue = std::make_shared<TrajectoryQueue>(4);
+    game.setTrajectoryQueue(queue, 3);
+    game.reset();
+    while (!game.step(nullptr, nullptr, -1))
+        ;
+
+    auto episodes = queue->drain();
+    ASSERT_EQ(episodes.size(), 1);
+    const auto &episode = episodes[0];
+    EXPECT_EQ(episode.id, 3);
+    EXPECT_EQ(episode.winner, game.getWinner());
+    EXPECT_EQ(episode.actions, game.historical_actions);
+    ASSERT_EQ(episode.visit_offsets.size(), episode.length() + 1);
+    for (int i = 0; i < episode.length(); ++i)
+    {
+        EXPECT_EQ(episode.players[i], i % 2);
+        bool visited = false;
+        for (int j = episode.visit_offsets[i]; j < episode.visit_offsets[i + 1]; ++j)
+            visited |= episode.visits[j].first == episode.actions[i] && episode.visits[j].second > 0;
+        EXPECT_TRUE(visited);
+    }
+    EXPECT_EQ(queue->size(), 0);
+}
+
+TEST(GobangSelfPlayTest, PlayoutCap)
+{
+    // NOTE: only moves with a full search are part of the trajectory
+    int board_size = 7, num_search = 200, num_search_fast = 20;
+    GobangSelfPlay game(board_size, 4, 2, 1.0f, num_search);
+    game.setEvaluator(std::make_shared<RolloutEvaluator>(board_size, 4, 1, true, 0));
+    game.setMoveSampling(1.0f, 4);
+    game.setPlayoutCap(0.25f, num_search_fast);
+    auto queue = std::make_shared<TrajectoryQueue>(1);
+    game.setTrajectoryQueue(queue, 0);
+    game.seed(0);
+    game.reset();
+    std::vector<int> full_moves;
+    bool done = false;
+    while (!done)
+    {
+        done = game.step(nullptr, nullptr, -1);
+        const auto &visits = game.getSampledResult();
+        int visit_count = std::accumulate(visits.begin(), visits.end(), 0,
+                                          [](int sum, int visit)
+                                          { return sum + std::max(visit, 0); });
+        if (game.sampledFullSearch())
+        {
+            full_moves.push_back(game.historical_actions.size() - 1);
+            EXPECT_GE(visit_count, num_search - 1);
+        }
+        else
+            EXPECT_LT(visit_count, num_search - 1);
+    }
+    EXPECT_EQ(game.trajectoryLength(), full_moves.size());
+    EXPECT_LT(full_moves.size(), game.historical_actions.size());
+
+    auto episodes = queue->drain();
+    ASSERT_EQ(episodes.size(), 1);
+    ASSERT_EQ(episodes[0].length(), full_moves.size());
+    for (int i = 0; i < episodes[0].length(); ++i)
+    {
+        EXPECT_EQ(episodes[0].actions[i], game.historical_actions[full_moves[i]]);
+        EXPECT_EQ(episodes[0].players[i], full_moves[i] % 2);
+    }
+}
+
+TEST(GobangSelfPlayTest, EarlyStop)
+{
+    // NOTE: the root of each move is visited (incl. reused visits) or pruned num_search times
+    int board_size = 7, num_search = 400;
+    GobangSelfPlay game(board_size, 4, 2, 1.0f, num_search);
+    game.setEvaluator(std::make_shared<RolloutEvaluator>(board_size, 4, 1, true, 0));
+    game.setMoveSampling(1.0f, 4);
+    game.setEarlyStop(true);
+    game.seed(0);
+    game.reset();
+    int num_pruned = 0;
+    bool done = false;
+    while (!done)
+    {
+        done = game.step(nullptr, nullptr, -1);
+        const auto &visits = game.getSampledResult();
+        int visit_count = std::accumulate(visits.begin(), visits.end(), 0,
+                                          [](int sum, int visit)
+                                          { return sum + std::max(visit, 0); });
+        // NOTE: the first visit of the root expands it, i.e., no edge is visited
+        EXPECT_EQ(visit_count + 1 + game.sampledPrunedSimulations(), num_search);
+        num_pruned += game.sampledPrunedSimulations();
+    }
+    auto counters = game.getCounters();
+    EXPECT_GT(num_pruned, 0);
+    EXPECT_EQ(counters.num_pruned, num_pruned);
+    EXPECT_LE(counters.num_simulations + counters.num_pruned,
+              int64_t(game.historical_actions.size()) * num_search);
+}
+
+template <typename Game>
+static std::vector<int> playGame(int board_size, int win_length)
+{
+    Game game(board_size, win_length, 2, 1.0f, 200);
+    game.setEvaluator(std::make_shared<typename Game::RolloutEvaluator>(board_size, win_length, 1, true, 0));
+    game.setMoveSampling(1.0f, 4);
+    game.seed(0);
+    game.reset();
+    while (!game.step(nullptr, nullptr, -1))
+        ;
+    return game.historical_actions;
+}
+
+TEST(GobangSelfPlayTest, FixedSize)
+{
+    // NOTE: the same game is played with the compile-time board
+    auto actions = playGame<GobangSelfPlay>(9, 5);
+    auto fixed_actions = playGame<GobangSelfPlayT<9, 5>>(9, 5);
+    EXPECT_EQ(fixed_actions, actions);
+    EXPECT_GT(actions.size(), 0);
+}
+
+TEST(GobangSelfPlayTest, FixedSizeWinLength)
+{
+    // NOTE: a compile-time board with a runtime win_length
+    auto actions = playGame<GobangSelfPlay>(9, 4);
+    auto fixed_actions = playGame<GobangSelfPlayT<9, 0>>(9, 4);
+    EXPECT_EQ(fixed_actions, actions);
+    EXPECT_GT(actions.size(), 0);
+}
+
+TEST(GobangSelfPlayTest, Reuse)
+{
+    // NOTE: the players & their trees are reused by the next game, the counters restart
+    int board_size = 9;
+    GobangSelfPlay game(board_size, 5, 2, 1.0f, 200);
+    game.setMoveSampling(1.0f, 4);
+    std::vector<std::vector<int>> games;
+    for (int i = 0; i < 2; ++i)
+    {
+        // NOTE: a fresh evaluator, its rollouts are seeded
+        game.setEvaluator(std::make_shared<RolloutEvaluator>(board_size, 5, 1, true, 0));
+        game.seed(0);
+        game.reset();
+        EXPECT_EQ(game.getCounters().num_simulations, 0);
+        EXPECT_EQ(game.peakNodes(), 2);
+        while (!game.step(nullptr, nullptr, -1))
+            ;
+        games.push_back(game.historical_actions);
+    }
+    EXPECT_EQ(games[0], games[1]);
+    EXPECT_EQ(games[0], playGame<GobangSelfPlay>(board_size, 5));
+}
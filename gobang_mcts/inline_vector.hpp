@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include "envpool/gobang_mcts/utils.hpp"
+
+template <typename T, int CAPACITY>
+class InlineVector
+{
+    // NOTE: the subset of std::vector used by GobangBoardT, stored inline,
+    //  i.e., no allocation and trivially copyable for a trivially copyable T
+private:
+    std::array<T, CAPACITY> items;
+    int count;
+
+public:
+    InlineVector() : count(0) {}
+
+    void reserve(int capacity)
+    {
+        assertMsg(capacity <= CAPACITY, "Capacity exceeded");
+    }
+
+    void resize(int size)
+    {
+        assertMsg(size <= CAPACITY, "Capacity exceeded");
+        count = size;
+    }
+
+    void assign(int size, const T &value)
+    {
+        resize(size);
+        std::fill(items.begin(), items.begin() + size, value);
+    }
+
+    void push_back(const T &value)
+    {
+        assertMsg(count < CAPACITY, "Capacity exceeded");
+        items[count++] = value;
+    }
+
+    void pop_back() { count--; }
+    void clear() { count = 0; }
+
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T &operator[](int i) { return items[i]; }
+    const T &operator[](int i) const { return items[i]; }
+    T &back() { return items[count - 1]; }
+    const T &back() const { return items[count - 1]; }
+
+    T *data() { return items.data(); }
+    const T *data() const { return items.data(); }
+    T *begin() { return items.data(); }
+    T *end() { return items.data() + count; }
+    const T *begin() const { return items.data(); }
+    const T *end() const { return items.data() + count; }
+};
+
+// NOTE: a std::vector for the dynamic board (N = 0), inline storage of N * N otherwise
+template <typename T, int N>
+using BoardVector = typename std::conditional<N == 0, std::vector<T>, InlineVector<T, N * N>>::type;
@@ -2,425 +2,603 @@
 
 #include <cmath>
 #include <memory>
+#include <random>
 #include <vector>
 #include <cassert>
+#include <cstdint>
 #include <limits>
+#include <algorithm>
 #include <iostream>
+#include <type_traits>
+#include <unordered_map>
 
 #include "envpool/gobang_mcts/utils.hpp"
+#include "envpool/gobang_mcts/profiler.hpp"
+#include "envpool/gobang_mcts/symmetry.hpp"
+#include "envpool/gobang_mcts/node_arena.hpp"
 
-struct PUCT
-{
-    float prior_prob;
-    float q_value;
-    int visit_count;
-    float c_puct;
-
-    PUCT(float prior_prob, float c_puct)
-        : prior_prob(prior_prob), q_value(0), visit_count(0), c_puct(c_puct)
-    {
-    }
-
-    void update(float v)
-    {
-        visit_count++;
-        q_value += (v - q_value) / visit_count;
-    }
-
-    float value(int parent_visit_count) const
-    {
-        return q_value + c_puct * prior_prob * sqrt(parent_visit_count) / (1 + visit_count);
-    }
-};
-
-struct TreeNode;
-
-class TreeNodePool : public std::enable_shared_from_this<TreeNodePool>
+template <typename Env>
+class MCTS
 {
-    // NOTE: HACK: why do we need TreeNodePool?
-    // Try not to allocate and free TreeNode objects during search.
-    // This would largely reduce the execution time of MCTS::step().
 private:
-    std::vector<TreeNode> nodes;
-    int allocated_count;
-
-public:
-    class Reference
-    {
-        // NOTE: this is a reference to a TreeNode in TreeNodePool
-        friend class TreeNodePool;
+    using Index = NodeArena::Index;
 
-    private:
-        std::weak_ptr<TreeNodePool> pool;
-        int index;
+    NodeArena nodes;
 
-    public:
-        Reference() : index(-1) {}
-        Reference(std::weak_ptr<TreeNodePool> pool, int index) : pool(pool), index(index) {}
-        Reference(const Reference &ref) : pool(ref.pool), index(ref.index) {}
+    const float c_puct;
+    int num_search;
+    const int leaves_per_step;
+    const bool use_transposition, canonical_transposition;
 
-        void clear() { index = -1; }
-        bool empty() const
-        {
-            return pool.expired() || index == -1;
-        }
+    int current_search;
+    Index root;
+
+    // NOTE: env is the root position plus env_depth moves, i.e., the path to the
+    //  selected (or a pending) leaf, rewind() undoes them instead of copying the root back
+    int env_depth;
+    std::vector<int> path_actions;
+
+    // resume from pending leaves
+    //  env_leaf is the pending leaf that env currently holds (-1 if none)
+    Index selected_node;
+    std::vector<Index> pending_leaves;
+    int env_leaf;
+    std::shared_ptr<Env> env;
+    int winner;
 
-        TreeNode &operator*()
+    // NOTE: per-search transposition table, cleared on every step
+    //  a leaf whose (canonical) hash is already expanded in the tree
+    //  reuses the stored priors & value instead of being evaluated again
+    struct Transposition
+    {
+        Index node;
+        float value;
+        int symmetry;
+    };
+    std::unordered_map<uint64_t, Transposition> transpositions;
+    std::vector<std::pair<uint64_t, int>> pending_hashes;
+    std::vector<float> transposed_probs;
+    int num_transposition_hits;
+
+    // NOTE: the last hash_history moves are part of the transposition & cache keys,
+    //  see setHashHistory()
+    int hash_history;
+
+    // NOTE: expansions refused by the memory budget of NodeArena,
+    //  the leaf is still backed up with its value but stays a leaf.
+    //  A refused materialisation backs up the Q value of its parent instead.
+    int num_refused_expansions;
+    bool refused_select;
+
+    // NOTE: instrumentation, see Profile
+    Profile::SearchCounters counters;
+
+    // NOTE: early stop, checked every EARLY_STOP_INTERVAL simulations,
+    //  the search stops once the most visited root child can no longer be overtaken
+    //  by the second one, the skipped simulations are pruned_simulations
+    static constexpr int EARLY_STOP_INTERVAL = 16;
+    bool early_stop, stopped_early;
+    int next_stop_check, pruned_simulations;
+
+    bool canStopEarly()
+    {
+        if (nodes.isLeaf(root))
+            return false;
+        if (nodes.numChildren(root) == 1)
+            return true;
+        int best = 0, second = 0;
+        Index first = nodes.firstEdge(root), last = first + nodes.numChildren(root);
+        for (Index edge = first; edge < last; ++edge)
         {
-            assertMsg(!empty(), "Cannot dereference an empty reference");
-            return pool.lock()->nodes[index];
+            int visit_count = nodes.edgeVisitCount(edge);
+            if (visit_count > best)
+                second = best, best = visit_count;
+            else if (visit_count > second)
+                second = visit_count;
         }
+        return second + (num_search - current_search) < best;
+    }
 
-        const TreeNode &operator*() const
-        {
-            assertMsg(!empty(), "Cannot dereference an empty reference");
-            return pool.lock()->nodes[index];
-        }
-    };
+    // NOTE: scratch for searchWith()
+    std::vector<float> evaluated_probs;
 
-    TreeNodePool() = default;
+    // NOTE: Dirichlet noise on the priors of the root (disabled if dirichlet_alpha = 0),
+    //  mixed in once per move, when the root is expanded or at the start of a search
+    //  that continues from a reused subtree
+    float dirichlet_alpha, dirichlet_epsilon;
+    std::mt19937 rng;
+    bool root_noised;
+    std::vector<float> root_noise;
 
-    template <typename... Args>
-    void reserve(int size, Args &&...args)
+    void addRootNoise()
     {
-        assertMsg(nodes.empty() && size > 0,
-                  "Cannot reserve space for TreeNodePool twice");
-        nodes.reserve(size);
-        for (int i = 0; i < size; ++i)
-            nodes.emplace_back(shared_from_this(), i, std::forward<Args>(args)...);
+        root_noised = true;
+        Index first = nodes.firstEdge(root);
+        root_noise.resize(nodes.numChildren(root));
+        std::gamma_distribution<float> gamma(dirichlet_alpha, 1.0f);
+        float sum = 0;
+        for (auto &noise : root_noise)
+            sum += noise = gamma(rng);
+        if (sum <= 0)
+            return;
+        for (int i = 0; i < static_cast<int>(root_noise.size()); ++i)
+            nodes.setEdgePriorProb(first + i, (1 - dirichlet_epsilon) * nodes.edgePriorProb(first + i) +
+                                                  dirichlet_epsilon * root_noise[i] / sum);
     }
 
-    Reference allocate()
+    void rewind()
     {
-        assertMsg(allocated_count < nodes.size(),
-                  "No more space to allocate");
-        return Reference(shared_from_this(), allocated_count++);
+        for (; env_depth > 0; --env_depth)
+            env->undo();
     }
 
-    void clear()
+    void restoreLeaf(int i)
     {
-        allocated_count = 0;
+        // NOTE: replay the path from the root, O(depth) steps & undos
+        if (env_leaf == i)
+            return;
+        rewind();
+        path_actions.clear();
+        for (Index node = pending_leaves[i]; !nodes.isRoot(node); node = nodes.parent(node))
+            path_actions.push_back(nodes.action(node));
+        for (auto it = path_actions.rbegin(); it != path_actions.rend(); ++it)
+            env->step(*it);
+        env_depth = path_actions.size();
+        env_leaf = i;
     }
-};
 
-class RefVectorPool : public std::enable_shared_from_this<RefVectorPool>
-{
-    // NOTE: HACK: why do we need RefVectorPool?
-    // TreeNodePool::clear method can't free the memory of std::vector (owned by each TreeNode).
-    // which would cause excessive memory usage. So we use RefVectorPool to manage the memory.
-private:
-    std::vector<std::vector<TreeNodePool::Reference>> ref_vectors;
-    int allocated_count;
-
-public:
-    class Reference
+    bool isPending(Index node) const
     {
-        // NOTE: this is a reference to a std::vector<TreeNodePool::Reference> in RefVectorPool
-        friend class RefVectorPool;
-
-    private:
-        std::weak_ptr<RefVectorPool> pool;
-        int index;
+        return std::find(pending_leaves.begin(), pending_leaves.end(),
+                         node) != pending_leaves.end();
+    }
 
-    public:
-        Reference() : index(-1) {}
-        Reference(std::weak_ptr<RefVectorPool> pool, int index) : pool(pool), index(index) {}
-        Reference(const Reference &ref) : pool(ref.pool), index(ref.index) {}
+    void evaluateLeaf(int i, const float *prior_probs, float value)
+    {
+        restoreLeaf(i);
+        auto start = Profile::now();
+        if (expandNode(pending_leaves[i], prior_probs) && use_transposition)
+            transpositions.emplace(
+                pending_hashes[i].first,
+                Transposition{pending_leaves[i], value, pending_hashes[i].second});
+        Profile::record(counters.ticks[Profile::EXPAND], start);
+        backPropagate(pending_leaves[i], value, true);
+        current_search++;
+        counters.num_simulations++;
+    }
 
-        void clear() { index = -1; }
-        bool empty() const
+    void removePending(int i)
+    {
+        // NOTE: swap-remove, the last pending leaf takes index i
+        int last = pending_leaves.size() - 1;
+        pending_leaves[i] = pending_leaves[last];
+        pending_leaves.pop_back();
+        if (use_transposition)
         {
-            return pool.expired() || index == -1;
+            pending_hashes[i] = pending_hashes[last];
+            pending_hashes.pop_back();
         }
+        if (env_leaf == i)
+            env_leaf = -1;
+        else if (env_leaf == last)
+            env_leaf = i;
+    }
 
-        std::vector<TreeNodePool::Reference> &operator*()
+    void expandTransposition(Index node, const Transposition &source, int symmetry)
+    {
+        // NOTE: action a of source.node is action inverse(symmetry)(source.symmetry(a)) of node
+        int inverse_symmetry = Symmetry::inverse(symmetry);
+        Index first = nodes.firstEdge(source.node);
+        for (Index edge = first; edge < first + nodes.numChildren(source.node); ++edge)
         {
-            assertMsg(!empty(), "Cannot dereference an empty reference");
-            return pool.lock()->ref_vectors[index];
+            int action = env->transformAction(
+                inverse_symmetry, env->transformAction(source.symmetry, nodes.edgeAction(edge)));
+            transposed_probs[action] = nodes.edgePriorProb(edge);
         }
+        expandNode(node, transposed_probs.data());
+    }
+
+public:
+    MCTS(float c_puct, int num_search, std::shared_ptr<Env> env, int leaves_per_step = 1,
+         bool use_transposition = false, bool canonical_transposition = false,
+         size_t memory_budget = 0, bool huge_pages = false)
+        : nodes(memory_budget, huge_pages),
+          c_puct(c_puct), num_search(num_search), leaves_per_step(leaves_per_step),
+          use_transposition(use_transposition), canonical_transposition(canonical_transposition),
+          current_search(0), env_depth(0), selected_node(NodeArena::NONE),
+          env_leaf(-1), env(env), num_transposition_hits(0), hash_history(0),
+          num_refused_expansions(0), refused_select(false),
+          early_stop(false), stopped_early(false), next_stop_check(0), pruned_simulations(0),
+          dirichlet_alpha(0), dirichlet_epsilon(0), root_noised(false)
+    {
+        assertMsg(num_search > 0, "num_search must be positive");
+        assertMsg(leaves_per_step > 0, "leaves_per_step must be positive");
 
-        const std::vector<TreeNodePool::Reference> &operator*() const
+        pending_leaves.reserve(leaves_per_step);
+        path_actions.reserve(env->actionShape());
+        if (use_transposition)
         {
-            assertMsg(!empty(), "Cannot dereference an empty reference");
-            return pool.lock()->ref_vectors[index];
+            transpositions.reserve(num_search);
+            pending_hashes.reserve(leaves_per_step);
+            transposed_probs.resize(env->actionShape());
         }
-    };
-
-    RefVectorPool() = default;
 
-    void reserve(int size)
-    {
-        assertMsg(ref_vectors.empty() && size > 0,
-                  "Cannot reserve space for RefArrayPool twice");
-        ref_vectors.resize(size);
+        if (canonical_transposition)
+            env->setCanonicalHash(true);
+        root = nodes.allocate(NodeArena::NONE, -1);
     }
 
-    Reference allocate()
+    void reset(const Env &root_env)
     {
-        assertMsg(allocated_count < ref_vectors.size(),
-                  "No more space to allocate");
-        return Reference(shared_from_this(), allocated_count++);
+        // NOTE: start a new game from root_env, the chunks of the arena are kept,
+        //  the counters restart, the settings (num_search, early stop, noise...) are kept
+        *env = root_env;
+        if (canonical_transposition)
+            env->setCanonicalHash(true);
+        env_depth = 0;
+        path_actions.clear();
+        current_search = 0;
+        selected_node = NodeArena::NONE;
+        pending_leaves.clear();
+        pending_hashes.clear();
+        transpositions.clear();
+        env_leaf = -1;
+        num_transposition_hits = 0;
+        num_refused_expansions = 0;
+        counters = Profile::SearchCounters();
+        stopped_early = false;
+        next_stop_check = 0;
+        pruned_simulations = 0;
+        root_noised = false;
+        nodes.clear();
+        root = nodes.allocate(NodeArena::NONE, -1);
+        nodes.resetStats();
     }
 
-    void clear()
+    bool selectNode()
     {
-        allocated_count = 0;
-    }
-};
-
-struct TreeNode
-{
-    std::weak_ptr<TreeNodePool> tree_node_pool;
-    int index_of_this;
-
-    std::weak_ptr<RefVectorPool> ref_array_pool;
-
-    TreeNodePool::Reference parent_ref;
-    RefVectorPool::Reference children_refs;
-
-    int action;
-    PUCT puct;
-
-    TreeNode(std::weak_ptr<TreeNodePool> tree_node_pool, int index_of_this,
-             std::weak_ptr<RefVectorPool> ref_array_pool)
-        : tree_node_pool(tree_node_pool), index_of_this(index_of_this),
-          ref_array_pool(ref_array_pool), action(-1), puct(0, 0) {}
+        // MCTS: select
+        auto start = Profile::now();
+        selected_node = root;
+        refused_select = false;
+        rewind();
+        env_leaf = -1;
+        while (!nodes.isLeaf(selected_node))
+        {
+            Index child = nodes.select(selected_node, c_puct);
+            if (child == NodeArena::NONE)
+            {
+                refused_select = true;
+                Profile::record(counters.ticks[Profile::SELECT], start);
+                return false;
+            }
+            selected_node = child;
+            env->step(nodes.action(selected_node));
+            env_depth++;
+        }
+        Profile::record(counters.ticks[Profile::SELECT], start);
 
-    void setStat(const TreeNodePool::Reference &parent_ref,
-                 int action, float prior_prob, float c_puct)
-    {
-        this->parent_ref = parent_ref;
-        this->children_refs.clear();
-        this->action = action;
-        this->puct = PUCT(prior_prob, c_puct);
+        start = Profile::now();
+        auto result = env->checkFinished();
+        winner = result.second;
+        Profile::record(counters.ticks[Profile::TERMINAL], start);
+        return result.first;
     }
 
-    bool isRoot() const
+    bool expandNode(Index node, const float *prior_probs)
     {
-        return parent_ref.empty();
+        // MCTS: expand
+        if (nodes.expand(node, env->getActions(), prior_probs))
+        {
+            if (node == root && dirichlet_alpha > 0)
+                addRootNoise();
+            return true;
+        }
+        num_refused_expansions++;
+        return false;
     }
 
-    bool isLeaf() const
+    void backPropagate(Index node, float value, bool virtual_loss = false)
     {
-        return children_refs.empty();
+        // MCTS: back propagate
+        auto start = Profile::now();
+        while (true)
+        {
+            if (virtual_loss)
+                nodes.revertVirtualLoss(node);
+            nodes.update(node, value);
+            if (nodes.isRoot(node))
+                break;
+            value = -value;
+            node = nodes.parent(node);
+        }
+        Profile::record(counters.ticks[Profile::BACKPROP], start);
     }
 
-    int getVisitCount() const
+    void addVirtualLoss(Index node)
     {
-        return puct.visit_count;
+        // NOTE: discourage the following selections in this step from
+        //  choosing the same path until its leaf is evaluated
+        auto start = Profile::now();
+        while (true)
+        {
+            nodes.addVirtualLoss(node);
+            if (nodes.isRoot(node))
+                break;
+            node = nodes.parent(node);
+        }
+        Profile::record(counters.ticks[Profile::BACKPROP], start);
     }
 
-    void update(float v)
+    bool search(const std::vector<float> &prior_probs, float value)
     {
-        puct.update(v);
+        return search(prior_probs.data(), &value);
     }
 
-    float value(int parent_visit_count) const
+    bool search(const std::vector<float> &prior_probs, const std::vector<float> &values)
     {
-        return puct.value(parent_visit_count);
+        return search(prior_probs.data(), values.data());
     }
 
-    TreeNodePool::Reference select()
+    bool search(const float *prior_probs, const float *values)
     {
-        assertMsg(!this->isLeaf(), "Leaf node has no child to select");
-        TreeNodePool::Reference selected_child;
-        auto visit_count = this->getVisitCount();
-        float best_value = std::numeric_limits<float>::lowest();
-        for (const auto &child_ref : *children_refs)
+        // NOTE: selectNode before expand
+        //  would ignore prior_probs & values if there is no pending leaf
+        //  prior_probs: [numPendingLeaves(), actionShape()], values: [numPendingLeaves()]
+        for (int i = 0; i < static_cast<int>(pending_leaves.size()); ++i)
+            evaluateLeaf(i, prior_probs + i * env->actionShape(), values[i]);
+        pending_leaves.clear();
+        pending_hashes.clear();
+        if (dirichlet_alpha > 0 && !root_noised && !nodes.isLeaf(root))
+            addRootNoise();
+
+        while (!stopped_early && current_search + static_cast<int>(pending_leaves.size()) < num_search)
         {
-            float value = (*child_ref).value(visit_count);
-            if (value > best_value)
+            if (early_stop && current_search >= next_stop_check)
+            {
+                // NOTE: pending leaves are still resolved by the following calls
+                next_stop_check = current_search + EARLY_STOP_INTERVAL;
+                if (canStopEarly())
+                {
+                    stopped_early = true;
+                    pruned_simulations = num_search - current_search - static_cast<int>(pending_leaves.size());
+                    counters.num_pruned += pruned_simulations;
+                    break;
+                }
+            }
+            auto terminal = selectNode();
+            if (terminal)
             {
-                best_value = value;
-                selected_child = child_ref;
+                auto value = winner == -1 ? 0.0f : 1.0f;
+                backPropagate(selected_node, value);
+                current_search++;
+                counters.num_simulations++;
+                counters.num_terminal_hits++;
+                continue;
             }
+            if (refused_select)
+            {
+                backPropagate(selected_node, nodes.qValue(selected_node));
+                current_search++;
+                counters.num_simulations++;
+                num_refused_expansions++;
+                continue;
+            }
+
+            // NOTE: stop collecting on a collision with a pending leaf
+            if (isPending(selected_node))
+                break;
+            if (use_transposition)
+            {
+                auto hash = env->getHash(canonical_transposition, hash_history);
+                auto it = transpositions.find(hash.first);
+                if (it != transpositions.end())
+                {
+                    auto start = Profile::now();
+                    expandTransposition(selected_node, it->second, hash.second);
+                    Profile::record(counters.ticks[Profile::EXPAND], start);
+                    backPropagate(selected_node, it->second.value);
+                    current_search++;
+                    counters.num_simulations++;
+                    num_transposition_hits++;
+                    continue;
+                }
+                pending_hashes.push_back(hash);
+            }
+            addVirtualLoss(selected_node);
+            env_leaf = pending_leaves.size();
+            pending_leaves.push_back(selected_node);
+            counters.num_leaves++;
+            if (static_cast<int>(pending_leaves.size()) == leaves_per_step)
+                break;
         }
-        return selected_child;
+        return pending_leaves.empty();
     }
 
-    void expand(const std::vector<std::pair<int, float>> &actions_probs, float c_puct)
+    template <typename Evaluator>
+    bool searchWith(Evaluator &evaluator)
     {
-        assertMsg(!tree_node_pool.expired() && !ref_array_pool.expired(),
-                  "Reference to TreeNodePool or RefVectorPool is expired");
-
-        auto this_ref = TreeNodePool::Reference(tree_node_pool, index_of_this);
-        children_refs = ref_array_pool.lock()->allocate();
-        (*children_refs).resize(actions_probs.size());
-        for (int i = 0; i < actions_probs.size(); ++i)
+        // NOTE: evaluate the leaves in C++, called as
+        //  float evaluator(Env &env, std::vector<float> &prior_probs),
+        //  finishes the search without returning pending leaves
+        evaluated_probs.resize(env->actionShape());
+        while (true)
         {
-            auto &child_ref = (*children_refs)[i];
-            child_ref = tree_node_pool.lock()->allocate();
-            (*child_ref).setStat(this_ref, actions_probs[i].first, actions_probs[i].second, c_puct);
+            for (int i = pending_leaves.size() - 1; i >= 0; --i)
+            {
+                restoreLeaf(i);
+                auto start = Profile::now();
+                float value = evaluator(*env, evaluated_probs);
+                Profile::record(counters.ticks[Profile::EVALUATE], start);
+                resolveLeaf(i, evaluated_probs.data(), value);
+            }
+            if (search(nullptr, nullptr))
+                return true;
         }
     }
 
-    TreeNodePool::Reference step(int action)
+    void setEarlyStop(bool early_stop)
     {
-        TreeNodePool::Reference next_root;
-        for (const auto &child_ref : *children_refs)
-            if ((*child_ref).action == action)
-            {
-                next_root = child_ref;
-                break;
-            }
-        if (!next_root.empty())
-            (*next_root).parent_ref = TreeNodePool::Reference();
-
-        return next_root;
+        this->early_stop = early_stop;
     }
 
-    void display()
+    void setHashHistory(int num_moves)
     {
-        std::cout << "Total visit count: "
-                  << this->getVisitCount() << std::endl;
-        for (const auto &child_ref : *children_refs)
-        {
-            std::cout << "  Action: " << (*child_ref).action << " ";
-            std::cout << "Visit count: " << (*child_ref).getVisitCount() << " ";
-            std::cout << "Q value: " << (*child_ref).puct.q_value << " ";
-            std::cout << "Value: " << (*child_ref).value(this->getVisitCount()) << std::endl;
-        }
+        // NOTE: the evaluation depends on the history planes of the state,
+        //  i.e., the last 2 * (num_player_planes - 1) moves
+        assertMsg(num_moves >= 0, "num_moves must be non-negative");
+        this->hash_history = num_moves;
     }
-};
 
-template <typename Env, typename EnvStat>
-class MCTS
-{
-private:
-    std::shared_ptr<TreeNodePool> tree_node_pool;
-    std::shared_ptr<RefVectorPool> ref_array_pool;
-
-    const float c_puct;
-    const int num_search;
+    int numPrunedSimulations() const
+    {
+        // NOTE: simulations skipped by the early stop of the current move
+        return pruned_simulations;
+    }
 
-    int current_search;
-    TreeNodePool::Reference root_ref;
-    EnvStat stat;
+    void setNumSearch(int num_search)
+    {
+        // NOTE: budget of the current & following moves, e.g., for playout cap randomisation
+        assertMsg(num_search > 0, "num_search must be positive");
+        this->num_search = num_search;
+    }
 
-    // resume from selected node
-    TreeNodePool::Reference selected_node;
-    std::shared_ptr<Env> env;
-    int winner;
+    void setRootNoise(float alpha, float epsilon, uint32_t seed)
+    {
+        // NOTE: P(a) = (1 - epsilon) * P(a) + epsilon * Dir(alpha) at the root
+        assertMsg(alpha >= 0 && epsilon >= 0 && epsilon <= 1,
+                  "alpha must be non-negative and epsilon in [0, 1]");
+        dirichlet_alpha = alpha;
+        dirichlet_epsilon = epsilon;
+        rng.seed(seed);
+    }
 
-public:
-    MCTS(float c_puct, int num_search, std::shared_ptr<Env> env)
-        : tree_node_pool(std::make_shared<TreeNodePool>()),
-          ref_array_pool(std::make_shared<RefVectorPool>()),
-          c_puct(c_puct), num_search(num_search), current_search(0),
-          stat(env->getStat()), env(env)
+    int numPendingLeaves() const
     {
-        assertMsg(num_search > 0, "num_search must be positive");
+        return pending_leaves.size();
+    }
 
-        ref_array_pool->reserve(num_search);
-        tree_node_pool->reserve(num_search * env->actionShape(), ref_array_pool);
+    int numTranspositionHits() const
+    {
+        return num_transposition_hits;
+    }
 
-        root_ref = tree_node_pool->allocate();
-        (*root_ref).setStat(TreeNodePool::Reference(), -1, 0, c_puct);
+    int numRefusedExpansions() const
+    {
+        return num_refused_expansions;
     }
 
-    bool selectNode()
+    int peakNodes() const
     {
-        // MCTS: select
-        selected_node = root_ref;
-        env->setStat(stat);
-        while (!(*selected_node).isLeaf())
-        {
-            selected_node = (*selected_node).select();
-            env->step((*selected_node).action);
-        }
+        return nodes.peakSize();
+    }
 
-        auto result = env->checkFinished();
-        winner = result.second;
-        return result.first;
+    Profile::SearchCounters getCounters() const
+    {
+        // NOTE: cumulative over the lifetime of this MCTS
+        auto result = counters;
+        result.num_nodes = nodes.totalSize();
+        result.num_edges = nodes.totalEdges();
+        return result;
     }
 
-    void expandNode(const std::vector<float> &prior_probs)
+    uint64_t getLeafHash(int i)
     {
-        // MCTS: expand
-        auto valid_actions = env->getActions();
-        std::vector<std::pair<int, float>> actions_probs;
-        actions_probs.reserve(valid_actions.size());
-        for (const auto &action : valid_actions)
-            actions_probs.push_back(std::make_pair(action, prior_probs[action]));
-        (*selected_node).expand(actions_probs, c_puct);
+        restoreLeaf(i);
+        return env->getHash(false, hash_history).first;
     }
 
-    void backPropagate(float value)
+    void resolveLeaf(int i, const float *prior_probs, float value)
     {
-        // MCTS: back propagate
-        while (true)
-        {
-            (*selected_node).update(value);
-            if ((*selected_node).isRoot())
-                break;
-            value = -value;
-            selected_node = (*selected_node).parent_ref;
-        }
+        // NOTE: evaluate pending leaf i out of band (e.g., from EvalCache),
+        //  it is removed from the pending leaves
+        evaluateLeaf(i, prior_probs, value);
+        removePending(i);
     }
 
-    bool search(const std::vector<float> &prior_probs, float value)
+    template <typename T>
+    void writeState(int num_player_planes, T *output)
     {
-        // NOTE: selectNode before expand
-        //  would ignore prior_probs & value if selected_node is nullptr
-        if (!selected_node.empty())
+        // NOTE: states of all pending leaves are written one after another
+        auto start = Profile::now();
+        if (pending_leaves.size() <= 1)
         {
-            expandNode(prior_probs);
-            backPropagate(value);
-            current_search++;
+            if (!pending_leaves.empty())
+                restoreLeaf(0);
+            env->writeState(num_player_planes, output);
         }
-
-        while (current_search < num_search)
+        else
         {
-            auto terminal = selectNode();
-            if (!terminal)
-                return false;
-            auto value = winner == -1 ? 0.0f : 1.0f;
-            backPropagate(value);
-            current_search++;
+            int state_size = env->stateSize(num_player_planes, std::is_same<T, uint64_t>::value);
+            for (int i = 0; i < static_cast<int>(pending_leaves.size()); ++i)
+            {
+                restoreLeaf(i);
+                env->writeState(num_player_planes, output + i * state_size);
+            }
         }
-        return true;
+        Profile::record(counters.ticks[Profile::ENCODE], start);
     }
 
     std::vector<int> getState(int num_player_planes)
     {
-        return env->getState(num_player_planes);
+        std::vector<int> states(std::max<int>(pending_leaves.size(), 1) *
+                                env->stateSize(num_player_planes));
+        writeState(num_player_planes, states.data());
+        return states;
     }
 
     std::vector<std::pair<int, int>> getResult(bool ignore_unfinished = false)
     {
-        assertMsg(ignore_unfinished || (*root_ref).getVisitCount() >= num_search,
+        assertMsg(ignore_unfinished || stopped_early || nodes.getVisitCount(root) >= num_search,
                   "MCTS search not finished");
         std::vector<std::pair<int, int>> actions_visits;
-        for (const auto &child_ref : (*(*root_ref).children_refs))
+        if (nodes.isLeaf(root))
+            return actions_visits;
+        Index first = nodes.firstEdge(root), last = first + nodes.numChildren(root);
+        for (Index edge = first; edge < last; ++edge)
             actions_visits.push_back(
-                std::make_pair((*child_ref).action, (*child_ref).getVisitCount()));
+                std::make_pair(nodes.edgeAction(edge), nodes.edgeVisitCount(edge)));
         return actions_visits;
     }
 
     void step(int action, bool reset_root = false)
     {
-        assertMsg(reset_root, "reset_root = false not implemented");
-        env->setStat(stat);
+        rewind();
         env->step(action);
-        stat = env->getStat();
 
-        tree_node_pool->clear();
-        ref_array_pool->clear();
         current_search = 0;
-        selected_node.clear();
-        root_ref = tree_node_pool->allocate();
-        (*root_ref).setStat(TreeNodePool::Reference(), -1, 0, c_puct);
-
-        // TODO: support reset_root = false
-        // root_ref = (*root_ref).step(action);
-        // if (root_ref.empty() || reset_root)
-        //     (*root_ref).setStat(TreeNodePool::Reference(), -1, 0, c_puct);
+        selected_node = NodeArena::NONE;
+        pending_leaves.clear();
+        pending_hashes.clear();
+        transpositions.clear();
+        env_leaf = -1;
+        root_noised = false;
+        stopped_early = false;
+        next_stop_check = 0;
+        pruned_simulations = 0;
+
+        // NOTE: reuse the subtree of the selected action if it exists,
+        //  its visits are kept and count toward num_search of the next search,
+        //  i.e., the tree never holds more than num_search expanded nodes
+        //  A subtree that no longer fits in the memory budget is dropped
+        auto next_root = nodes.findChild(root, action);
+        root = NodeArena::NONE;
+        if (!reset_root && next_root != NodeArena::NONE)
+            root = nodes.compact(next_root);
+        if (root == NodeArena::NONE)
+        {
+            nodes.clear();
+            root = nodes.allocate(NodeArena::NONE, -1);
+        }
+        else
+            current_search = std::min(nodes.getVisitCount(root), num_search);
     }
 
     void display()
     {
-        env->setStat(stat);
+        rewind();
+        env_leaf = -1;
         env->display();
-        (*root_ref).display();
+        nodes.display(root, c_puct);
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,110 @@
+#include "envpool/gobang_mcts/mcts.hpp"
+#include "envpool/gobang_mcts/node_arena.hpp"
+#include "envpool/gobang_mcts/gobang_env.hpp"
+
+#include <numeric>
+#include <algorithm>
+#include <benchmark/benchmark.h>
+
+using GobangMCTS = MCTS<GobangEnv>;
+
+struct UniformEvaluator
+{
+    template <typename Env>
+    float operator()(Env &env, std::vector<float> &prior_probs)
+    {
+        // NOTE: a fixed dummy network, uniform priors over the valid actions and value 0
+        const auto &actions = env.getActions();
+        std::fill(prior_probs.begin(), prior_probs.end(), 0.0f);
+        for (auto action : actions)
+            prior_probs[action] = 1.0f / actions.size();
+        return 0.0f;
+    }
+};
+
+static void BM_Expand(benchmark::State &state)
+{
+    // NOTE: ns per expansion of an empty board, the arena is cleared every 256 expansions,
+    //  args: board_size
+    int flatten_size = state.range(0) * state.range(0);
+    std::vector<int> valid_actions(flatten_size);
+    std::iota(valid_actions.begin(), valid_actions.end(), 0);
+    std::vector<float> prior_probs(flatten_size, 1.0f / flatten_size);
+    NodeArena nodes;
+    int count = 0;
+    for (auto _ : state)
+    {
+        if (count++ % 256 == 0)
+            nodes.clear();
+        auto node = nodes.allocate(NodeArena::NONE, -1);
+        benchmark::DoNotOptimize(nodes.expand(node, valid_actions, prior_probs.data()));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Expand)->Arg(9)->Arg(15)->Arg(19);
+
+static void BM_Select(benchmark::State &state)
+{
+    // NOTE: ns per PUCT selection among all moves of an empty board, args: board_size
+    int flatten_size = state.range(0) * state.range(0);
+    std::vector<int> valid_actions(flatten_size);
+    std::iota(valid_actions.begin(), valid_actions.end(), 0);
+    std::vector<float> prior_probs(flatten_size, 1.0f / flatten_size);
+    NodeArena nodes;
+    auto root = nodes.allocate(NodeArena::NONE, -1);
+    nodes.expand(root, valid_actions, prior_probs.data());
+    nodes.update(root, 0.0f);
+    for (auto _ : state)
+    {
+        // NOTE: alternate the results to spread the visits
+        auto child = nodes.select(root, 1.0f);
+        nodes.update(child, nodes.getVisitCount(root) % 2 ? 1.0f : -1.0f);
+        nodes.update(root, 0.0f);
+        benchmark::DoNotOptimize(child);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Select)->Arg(9)->Arg(15)->Arg(19);
+
+static void BM_Search(benchmark::State &state)
+{
+    // NOTE: a whole opening search with the dummy evaluator, args: board_size, num_search
+    int board_size = state.range(0), num_search = state.range(1);
+    GobangEnv env(board_size, 5);
+    env.reset();
+    UniformEvaluator evaluator;
+    for (auto _ : state)
+    {
+        GobangMCTS mcts(1.0, num_search, std::make_shared<GobangEnv>(env));
+        mcts.searchWith(evaluator);
+        benchmark::DoNotOptimize(mcts.peakNodes());
+    }
+    state.counters["simulations/s"] = benchmark::Counter(
+        static_cast<double>(num_search) * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Search)
+    ->ArgsProduct({{9, 15, 19}, {100, 800, 3200}})
+    ->Unit(benchmark::kMillisecond);
+
+template <int N>
+static void BM_FixedSearch(benchmark::State &state)
+{
+    // NOTE: same as BM_Search with the compile-time board, args: num_search
+    int num_search = state.range(0);
+    GobangEnvT<N, 5> env(N, 5);
+    env.reset();
+    UniformEvaluator evaluator;
+    for (auto _ : state)
+    {
+        MCTS<GobangEnvT<N, 5>> mcts(1.0, num_search, std::make_shared<GobangEnvT<N, 5>>(env));
+        mcts.searchWith(evaluator);
+        benchmark::DoNotOptimize(mcts.peakNodes());
+    }
+    state.counters["simulations/s"] = benchmark::Counter(
+        static_cast<double>(num_search) * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK_TEMPLATE(BM_FixedSearch, 9)->Arg(100)->Arg(800)->Arg(3200)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_FixedSearch, 15)->Arg(100)->Arg(800)->Arg(3200)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_FixedSearch, 19)->Arg(100)->Arg(800)->Arg(3200)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -1,10 +1,12 @@
 #include "envpool/gobang_mcts/mcts.hpp"
 #include "envpool/gobang_mcts/gobang_env.hpp"
 
+#include <cmath>
 #include <numeric>
+#include <algorithm>
 #include <gtest/gtest.h>
 
-using GobangMCTS = MCTS<GobangEnv, GobangBoard>;
+using GobangMCTS = MCTS<GobangEnv>;
 
 TEST(MCTSTest, Encode)
 {
@@ -54,7 +56,7 @@ TEST(MCTSTest, Search)
     mcts->display();
     auto result = mcts->getResult();
     int best_action, visit_count = 0;
-    for (int i = 0; i < result.size(); i++)
+    for (size_t i = 0; i < result.size(); i++)
     {
         if (result[i].second > visit_count)
         {
@@ -72,6 +74,7 @@ TEST(MCTSTest, Search)
         [](int sum, const std::pair<int, int> &p)
         { return sum + p.second; });
     EXPECT_EQ(result_before.size(), 8 * 8 - 8);
+    EXPECT_GT(visit_count_before, 0); // reused subtree
     done = mcts->search({}, 0);
     while (!done)
     {
@@ -85,10 +88,266 @@ TEST(MCTSTest, Search)
         result_after.begin(), result_after.end(), 0,
         [](int sum, const std::pair<int, int> &p)
         { return sum + p.second; });
-    EXPECT_EQ(visit_count_after - visit_count_before, num_search);
+    // NOTE: the reused visits count toward num_search
+    EXPECT_GT(visit_count_after, visit_count_before);
+    EXPECT_EQ(visit_count_after, num_search - 1);
 
     // reset root
     mcts->step(30, true);
     result = mcts->getResult(true);
     EXPECT_TRUE(result.empty());
-}
\ No newline at end of file
+}
+TEST(MCTSTest, BatchedLeaves)
+{
+    GobangEnv env(8, 5);
+    env.reset();
+    for (auto action : {0, 8, 1, 9, 2, 10, 3})
+        env.step(action);
+
+    std::shared_ptr<GobangEnv> mcts_env = std::make_shared<GobangEnv>(env);
+    int num_search = 1000, leaves_per_step = 8, num_player_planes = 2;
+    auto mcts = std::make_shared<GobangMCTS>(1.0, num_search, mcts_env, leaves_per_step);
+    int num_steps = 0;
+    auto done = mcts->search({}, 0);
+    while (!done)
+    {
+        int num_leaves = mcts->numPendingLeaves();
+        EXPECT_GT(num_leaves, 0);
+        EXPECT_LE(num_leaves, leaves_per_step);
+        auto states = mcts->getState(num_player_planes);
+        EXPECT_EQ(states.size(), num_leaves * (num_player_planes * 2 + 1) * 8 * 8);
+        std::vector<float> prior_probs(num_leaves * 8 * 8, .1f);
+        std::vector<float> values(num_leaves, 0.0f);
+        done = mcts->search(prior_probs, values);
+        num_steps++;
+    }
+    EXPECT_EQ(mcts->numPendingLeaves(), 0);
+    EXPECT_LT(num_steps, num_search / 2);
+
+    auto result = mcts->getResult();
+    auto best = std::max_element(
+        result.begin(), result.end(),
+        [](const std::pair<int, int> &a, const std::pair<int, int> &b)
+        { return a.second < b.second; });
+    EXPECT_EQ(best->first, 4);
+    auto visit_count = std::accumulate(
+        result.begin(), result.end(), 0,
+        [](int sum, const std::pair<int, int> &p)
+        { return sum + p.second; });
+    EXPECT_EQ(visit_count, num_search - 1); // the 1st visit expands root
+}
+
+TEST(MCTSTest, Transposition)
+{
+    GobangEnv env(8, 5);
+    env.reset();
+    env.step(27);
+
+    int num_search = 2000;
+    std::vector<int> num_evaluations;
+    for (auto mode : {0, 1, 2}) // off, exact, canonical
+    {
+        std::shared_ptr<GobangEnv> mcts_env = std::make_shared<GobangEnv>(env);
+        auto mcts = std::make_shared<GobangMCTS>(
+            1.0, num_search, mcts_env, 1, mode > 0, mode > 1);
+        // NOTE: priors concentrated around the centre make the tree deep enough to transpose
+        std::vector<float> prior_probs(8 * 8, .001f);
+        for (auto action : {18, 19, 20, 26, 28, 34, 35, 36})
+            prior_probs[action] = 1.0f;
+        int num_evaluation = 0;
+        auto done = mcts->search({}, 0);
+        while (!done)
+        {
+            done = mcts->search(prior_probs, 0.0f);
+            num_evaluation++;
+        }
+        EXPECT_EQ(mcts->numTranspositionHits() > 0, mode > 0);
+        EXPECT_LE(num_evaluation + mcts->numTranspositionHits(), num_search);
+        num_evaluations.push_back(num_evaluation);
+    }
+    EXPECT_LT(num_evaluations[1], num_evaluations[0]);
+    EXPECT_LE(num_evaluations[2], num_evaluations[1]);
+
+    // NOTE: with history planes, a transposition must also match the last moves
+    std::vector<int> num_hits;
+    for (auto num_history : {0, 2})
+    {
+        std::shared_ptr<GobangEnv> mcts_env = std::make_shared<GobangEnv>(env);
+        auto mcts = std::make_shared<GobangMCTS>(1.0, num_search, mcts_env, 1, true);
+        mcts->setHashHistory(num_history);
+        std::vector<float> prior_probs(8 * 8, .001f);
+        for (auto action : {18, 19, 20, 26, 28, 34, 35, 36})
+            prior_probs[action] = 1.0f;
+        auto done = mcts->search({}, 0);
+        while (!done)
+            done = mcts->search(prior_probs, 0.0f);
+        num_hits.push_back(mcts->numTranspositionHits());
+    }
+    EXPECT_LT(num_hits[1], num_hits[0]);
+}
+
+TEST(MCTSTest, MemoryBudget)
+{
+    GobangEnv env(15, 5);
+    env.reset();
+
+    // NOTE: 1000 simulations need ~225,000 edges, the budget only fits one chunk of each
+    std::shared_ptr<GobangEnv> mcts_env = std::make_shared<GobangEnv>(env);
+    int num_search = 1000;
+    size_t memory_budget = NodeArena::CHUNK_SIZE * (NodeArena::NODE_BYTES + NodeArena::EDGE_BYTES);
+    auto mcts = std::make_shared<GobangMCTS>(1.0, num_search, mcts_env, 1,
+                                             false, false, memory_budget);
+    auto done = mcts->search({}, 0);
+    while (!done)
+    {
+        std::vector<float> prior_probs(15 * 15, 1.0f / (15 * 15));
+        done = mcts->search(prior_probs, 0.0f);
+    }
+    EXPECT_GT(mcts->numRefusedExpansions(), 0);
+    // only visited children are materialised
+    EXPECT_LE(mcts->peakNodes(), num_search);
+    auto result = mcts->getResult();
+    auto visit_count = std::accumulate(
+        result.begin(), result.end(), 0,
+        [](int sum, const std::pair<int, int> &p)
+        { return sum + p.second; });
+    EXPECT_EQ(visit_count, num_search - 1);
+
+    // the reused subtree always fits
+    auto best = std::max_element(
+        result.begin(), result.end(),
+        [](const std::pair<int, int> &a, const std::pair<int, int> &b)
+        { return a.second < b.second; });
+    mcts->step(best->first);
+    EXPECT_GT(mcts->getResult(true).size(), 0);
+}
+
+TEST(MCTSTest, RootNoise)
+{
+    // NOTE: with uniform priors & values, the visits only follow the noise
+    auto search = [](float alpha, uint32_t seed)
+    {
+        GobangEnv env(9, 5);
+        env.reset();
+        GobangMCTS mcts(1.0, 400, std::make_shared<GobangEnv>(env));
+        mcts.setRootNoise(alpha, 0.5f, seed);
+        std::vector<float> prior_probs(9 * 9, 1.0f / (9 * 9));
+        bool done = mcts.search({}, 0);
+        while (!done)
+            done = mcts.search(prior_probs, 0.0f);
+        std::vector<int> visits;
+        for (const auto &action_visit : mcts.getResult())
+            visits.push_back(action_visit.second);
+        return visits;
+    };
+    auto uniform_visits = search(0.0f, 0);
+    auto noised_visits = search(0.03f, 0);
+    EXPECT_GT(*std::max_element(noised_visits.begin(), noised_visits.end()),
+              2 * *std::max_element(uniform_visits.begin(), uniform_visits.end()));
+    EXPECT_EQ(search(0.03f, 0), noised_visits);
+    EXPECT_NE(search(0.03f, 1), noised_visits);
+}
+
+TEST(MCTSTest, Counters)
+{
+    GobangEnv env(9, 5);
+    env.reset();
+    int num_search = 200;
+    GobangMCTS mcts(1.0, num_search, std::make_shared<GobangEnv>(env), 4);
+    std::vector<float> prior_probs(4 * 9 * 9, 1.0f / (9 * 9)), values(4, 0.0f);
+    bool done = mcts.search({}, {});
+    while (!done)
+        done = mcts.search(prior_probs, values);
+    auto counters = mcts.getCounters();
+    EXPECT_EQ(counters.num_simulations, num_search);
+    EXPECT_EQ(counters.num_leaves, num_search - counters.num_terminal_hits);
+    EXPECT_EQ(counters.num_nodes, mcts.peakNodes());
+    EXPECT_GE(counters.num_edges, counters.num_leaves * (9 * 9 - 10));
+    // NOTE: phase timers are compiled out unless GOBANG_PROFILE is defined
+    for (int phase : {Profile::SELECT, Profile::TERMINAL, Profile::EXPAND, Profile::BACKPROP})
+        EXPECT_EQ(counters.ticks[phase] > 0, Profile::ENABLED);
+    EXPECT_EQ(counters.ticks[Profile::EVALUATE], 0);
+}
+
+TEST(MCTSTest, EarlyStop)
+{
+    // NOTE: the winning move 4 soon collects more visits than the remaining simulations
+    GobangEnv env(8, 5);
+    env.reset();
+    for (int action : {0, 8, 1, 9, 2, 10, 3})
+        env.step(action);
+    int num_search = 1000;
+    for (int leaves_per_step : {1, 4})
+    {
+        GobangMCTS mcts(1.0, num_search, std::make_shared<GobangEnv>(env), leaves_per_step);
+        mcts.setEarlyStop(true);
+        std::vector<float> prior_probs(leaves_per_step * 8 * 8, .1f), values(leaves_per_step, 0.0f);
+        bool done = mcts.search({}, {});
+        while (!done)
+            done = mcts.search(prior_probs, values);
+        auto result = mcts.getResult();
+        auto best = std::max_element(
+            result.begin(), result.end(),
+            [](const std::pair<int, int> &a, const std::pair<int, int> &b)
+            { return a.second < b.second; });
+        EXPECT_EQ(best->first, 4);
+        int visit_count = std::accumulate(
+            result.begin(), result.end(), 0,
+            [](int sum, const std::pair<int, int> &p)
+            { return sum + p.second; });
+        EXPECT_GT(mcts.numPrunedSimulations(), 0);
+        // NOTE: the first simulation expands the root, i.e., no edge is visited
+        EXPECT_EQ(visit_count + mcts.numPrunedSimulations(), num_search - 1);
+        EXPECT_EQ(mcts.getCounters().num_pruned, mcts.numPrunedSimulations());
+
+        mcts.step(best->first + 10);
+        EXPECT_EQ(mcts.numPrunedSimulations(), 0);
+    }
+}
+
+TEST(MCTSTest, SubtreeReuse)
+{
+    // NOTE: peaked priors keep most visits in the subtree of the played move,
+    //  whose visits count toward num_search of the next move
+    int board_size = 15, num_search = 200;
+    GobangEnv env(board_size, 5);
+    env.reset();
+    GobangMCTS mcts(1.0, num_search, std::make_shared<GobangEnv>(env));
+    std::vector<float> prior_probs(board_size * board_size);
+    for (int i = 0; i < board_size * board_size; i++)
+    {
+        int row = i / board_size - board_size / 2, col = i % board_size - board_size / 2;
+        prior_probs[i] = std::exp(-float(row * row + col * col));
+    }
+    for (int move = 0; move < 10; move++)
+    {
+        auto reused_result = mcts.getResult(true);
+        int reused_visits = 0;
+        for (const auto &action_visit : reused_result)
+            reused_visits += action_visit.second;
+        if (move > 0)
+        {
+            EXPECT_GT(reused_visits, 0);
+        }
+        auto simulations = mcts.getCounters().num_simulations;
+
+        bool done = mcts.search({}, 0);
+        while (!done)
+            done = mcts.search(prior_probs, 0.0f);
+        auto result = mcts.getResult();
+        auto best = std::max_element(
+            result.begin(), result.end(),
+            [](const std::pair<int, int> &a, const std::pair<int, int> &b)
+            { return a.second < b.second; });
+        int visit_count = std::accumulate(
+            result.begin(), result.end(), 0,
+            [](int sum, const std::pair<int, int> &p)
+            { return sum + p.second; });
+        EXPECT_EQ(visit_count, num_search - 1);
+        // NOTE: the reused root already had reused_visits + 1 visits
+        EXPECT_EQ(mcts.getCounters().num_simulations - simulations,
+                  num_search - (move > 0 ? reused_visits + 1 : 0));
+        EXPECT_LE(mcts.peakNodes(), num_search + 1);
+        mcts.step(best->first);
+    }
+}
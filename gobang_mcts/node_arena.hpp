@@ -0,0 +1,555 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <iostream>
+
+#include <sys/mman.h>
+
+#if !defined(GOBANG_NO_SIMD) && defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include "envpool/gobang_mcts/utils.hpp"
+
+class NodeArena
+{
+    // NOTE: HACK: why do we need NodeArena?
+    // Try not to allocate and free tree nodes during search.
+    // This would largely reduce the execution time of MCTS::step().
+    //
+    // Nodes are addressed by plain 32-bit indices and stored as structure-of-arrays.
+    //  An expansion only stores compact edges (child, action, fp16 prior),
+    //  the edges of a node occupy [first_edge, first_edge + num_children).
+    //  A child node is materialised when select() first visits its edge,
+    //  thus most legal moves never cost more than EDGE_BYTES.
+    //
+    // Storage grows on demand in chunks of CHUNK_SIZE nodes / edges, an edge range
+    //  never crosses a chunk. Chunks are kept by clear() and released by the destructor.
+    //  With max_bytes > 0, expansions, materialisations & compactions that need
+    //  a new chunk of nodes or edges beyond the budget are refused,
+    //  only the allocation of a root is never refused. The first chunk of nodes & edges
+    //  is allocated whatever the budget, thus a budget is at least minBytes().
+    //  Only the chunks are counted, not the transposition table of MCTS
+    //  nor the temporary vectors of compact().
+    //  With huge_pages, chunks are mmap-ed and advised to use transparent huge pages.
+public:
+    using Index = int32_t;
+    static constexpr Index NONE = -1;
+    static constexpr int CHUNK_BITS = 16;
+    static constexpr Index CHUNK_SIZE = 1 << CHUNK_BITS;
+    static constexpr size_t NODE_BYTES = 3 * sizeof(Index) + sizeof(float) +
+                                         sizeof(int32_t) + 2 * sizeof(int16_t);
+    static constexpr size_t EDGE_BYTES = sizeof(Index) + 2 * sizeof(int16_t);
+
+private:
+    struct NodeChunk
+    {
+        char *data;
+        Index *parents;
+        Index *first_edges;
+        Index *edges;
+        float *q_values;
+        int32_t *visit_counts;
+        uint16_t *num_children;
+        int16_t *actions;
+    };
+
+    struct EdgeChunk
+    {
+        char *data;
+        Index *children;
+        int16_t *actions;
+        uint16_t *prior_probs;
+    };
+
+    std::vector<NodeChunk> node_chunks;
+    std::vector<EdgeChunk> edge_chunks;
+    const size_t max_bytes;
+    const bool huge_pages;
+    Index allocated_count, allocated_edges;
+    Index peak_count, peak_edges;
+    // NOTE: cumulative # allocations (including compaction), kept by clear()
+    int64_t total_count, total_edges;
+
+    static uint16_t toHalf(float value)
+    {
+#if !defined(GOBANG_NO_SIMD) && defined(__F16C__)
+        return _cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+        // NOTE: round to nearest even, NaN is not expected for priors
+        uint32_t x;
+        std::memcpy(&x, &value, sizeof(x));
+        uint32_t sign = (x >> 16) & 0x8000, mantissa = x & 0x7fffff;
+        int exponent = static_cast<int>((x >> 23) & 0xff) - 127 + 15;
+        if (exponent >= 31)
+            return sign | 0x7c00;
+        if (exponent < -10)
+            return sign;
+        int shift = 13;
+        if (exponent <= 0)
+        {
+            // subnormal
+            mantissa |= 0x800000;
+            shift = 14 - exponent;
+            exponent = 0;
+        }
+        uint32_t half = (exponent << 10) | (mantissa >> shift);
+        uint32_t rest = mantissa & ((1u << shift) - 1), middle = 1u << (shift - 1);
+        if (rest > middle || (rest == middle && (half & 1)))
+            half++;
+        return sign | half;
+#endif
+    }
+
+    static float fromHalf(uint16_t half)
+    {
+#if !defined(GOBANG_NO_SIMD) && defined(__F16C__)
+        return _cvtsh_ss(half);
+#else
+        uint32_t sign = (half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1f, mantissa = half & 0x3ff;
+        if (exponent == 0)
+        {
+            float value = std::ldexp(static_cast<float>(mantissa), -24);
+            return sign ? -value : value;
+        }
+        uint32_t x = sign | (exponent == 31 ? 0x7f800000 | (mantissa << 13)
+                                            : ((exponent + 112) << 23) | (mantissa << 13));
+        float value;
+        std::memcpy(&value, &x, sizeof(value));
+        return value;
+#endif
+    }
+
+    static size_t chunkBytes(size_t record_bytes, bool huge_pages)
+    {
+        static const size_t HUGE_PAGE_BYTES = 2 << 20;
+        size_t bytes = CHUNK_SIZE * record_bytes;
+        return huge_pages ? (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES
+                          : bytes;
+    }
+
+    char *allocateChunk(size_t record_bytes)
+    {
+        size_t bytes = chunkBytes(record_bytes, huge_pages);
+        if (!huge_pages)
+            return static_cast<char *>(std::malloc(bytes));
+        void *data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+            return nullptr;
+#ifdef MADV_HUGEPAGE
+        madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+        return static_cast<char *>(data);
+    }
+
+    void freeChunk(char *data, size_t record_bytes)
+    {
+        if (huge_pages)
+            munmap(data, chunkBytes(record_bytes, huge_pages));
+        else
+            std::free(data);
+    }
+
+    bool withinBudget(size_t record_bytes) const
+    {
+        return max_bytes == 0 ||
+               capacityBytes() + chunkBytes(record_bytes, huge_pages) <= max_bytes;
+    }
+
+    bool addNodeChunk()
+    {
+        // 4-byte fields first, then 2-byte fields
+        NodeChunk chunk;
+        chunk.data = allocateChunk(NODE_BYTES);
+        if (chunk.data == nullptr)
+            return false;
+        chunk.parents = reinterpret_cast<Index *>(chunk.data);
+        chunk.first_edges = chunk.parents + CHUNK_SIZE;
+        chunk.edges = chunk.first_edges + CHUNK_SIZE;
+        chunk.q_values = reinterpret_cast<float *>(chunk.edges + CHUNK_SIZE);
+        chunk.visit_counts = reinterpret_cast<int32_t *>(chunk.q_values + CHUNK_SIZE);
+        chunk.num_children = reinterpret_cast<uint16_t *>(chunk.visit_counts + CHUNK_SIZE);
+        chunk.actions = reinterpret_cast<int16_t *>(chunk.num_children + CHUNK_SIZE);
+        node_chunks.push_back(chunk);
+        return true;
+    }
+
+    bool addEdgeChunk()
+    {
+        EdgeChunk chunk;
+        chunk.data = allocateChunk(EDGE_BYTES);
+        if (chunk.data == nullptr)
+            return false;
+        chunk.children = reinterpret_cast<Index *>(chunk.data);
+        chunk.actions = reinterpret_cast<int16_t *>(chunk.children + CHUNK_SIZE);
+        chunk.prior_probs = reinterpret_cast<uint16_t *>(chunk.actions + CHUNK_SIZE);
+        edge_chunks.push_back(chunk);
+        return true;
+    }
+
+    NodeChunk &nodeChunk(Index index) { return node_chunks[index >> CHUNK_BITS]; }
+    const NodeChunk &nodeChunk(Index index) const { return node_chunks[index >> CHUNK_BITS]; }
+    EdgeChunk &edgeChunk(Index edge) { return edge_chunks[edge >> CHUNK_BITS]; }
+    const EdgeChunk &edgeChunk(Index edge) const { return edge_chunks[edge >> CHUNK_BITS]; }
+    static Index offsetOf(Index index) { return index & (CHUNK_SIZE - 1); }
+
+    Index allocateEdges(int count, bool within_budget)
+    {
+        // NOTE: allocate count contiguous edges,
+        //  skip to the next chunk if they do not fit in the current one
+        assertMsg(count > 0 && count <= CHUNK_SIZE, "Invalid allocation size");
+        Index first = allocated_edges;
+        if (offsetOf(first) + count > CHUNK_SIZE)
+            first = (first | (CHUNK_SIZE - 1)) + 1;
+        size_t num_chunks = (first + count + CHUNK_SIZE - 1) >> CHUNK_BITS;
+        while (edge_chunks.size() < num_chunks)
+            if ((within_budget && !withinBudget(EDGE_BYTES)) || !addEdgeChunk())
+                return NONE;
+        allocated_edges = first + count;
+        total_edges += count;
+        peak_edges = std::max(peak_edges, allocated_edges);
+        return first;
+    }
+
+    Index materialise(Index index, Index edge)
+    {
+        Index child = allocate(index, edgeAction(edge), true);
+        if (child == NONE)
+            return NONE;
+        nodeChunk(child).edges[offsetOf(child)] = edge;
+        edgeChunk(edge).children[offsetOf(edge)] = child;
+        return child;
+    }
+
+public:
+    NodeArena(size_t max_bytes = 0, bool huge_pages = false)
+        : max_bytes(max_bytes), huge_pages(huge_pages),
+          allocated_count(0), allocated_edges(0), peak_count(0), peak_edges(0),
+          total_count(0), total_edges(0)
+    {
+        assertMsg(max_bytes == 0 || max_bytes >= minBytes(huge_pages),
+                  "NodeArena budget must fit a chunk of nodes & edges");
+    }
+
+    NodeArena(const NodeArena &) = delete;
+    NodeArena &operator=(const NodeArena &) = delete;
+
+    static size_t minBytes(bool huge_pages = false)
+    {
+        // NOTE: the smallest budget, a single chunk of nodes & edges
+        return chunkBytes(NODE_BYTES, huge_pages) + chunkBytes(EDGE_BYTES, huge_pages);
+    }
+
+    ~NodeArena()
+    {
+        for (auto &chunk : node_chunks)
+            freeChunk(chunk.data, NODE_BYTES);
+        for (auto &chunk : edge_chunks)
+            freeChunk(chunk.data, EDGE_BYTES);
+    }
+
+    Index allocate(Index parent, int action, bool within_budget = false)
+    {
+        // NOTE: allocate a single node, which is not linked to any edge,
+        //  returns NONE if within_budget and a new chunk exceeds the budget
+        if (static_cast<size_t>(allocated_count >> CHUNK_BITS) == node_chunks.size())
+        {
+            if (within_budget && !withinBudget(NODE_BYTES))
+                return NONE;
+            if (!addNodeChunk())
+                assertMsg(false, "Cannot allocate memory for NodeArena");
+        }
+        Index index = allocated_count++;
+        total_count++;
+        peak_count = std::max(peak_count, allocated_count);
+        auto &chunk = nodeChunk(index);
+        Index offset = offsetOf(index);
+        chunk.parents[offset] = parent;
+        chunk.first_edges[offset] = NONE;
+        chunk.edges[offset] = NONE;
+        chunk.num_children[offset] = 0;
+        chunk.actions[offset] = action;
+        chunk.q_values[offset] = 0;
+        chunk.visit_counts[offset] = 0;
+        return index;
+    }
+
+    void clear()
+    {
+        allocated_count = 0;
+        allocated_edges = 0;
+    }
+
+    void resetStats()
+    {
+        // NOTE: restart the peak & total counts, e.g., for a new episode
+        peak_count = total_count = allocated_count;
+        peak_edges = total_edges = allocated_edges;
+    }
+
+    Index size() const { return allocated_count; }
+    Index numEdges() const { return allocated_edges; }
+    Index peakSize() const { return peak_count; }
+    Index peakEdges() const { return peak_edges; }
+    int64_t totalSize() const { return total_count; }
+    int64_t totalEdges() const { return total_edges; }
+
+    size_t capacityBytes() const
+    {
+        return node_chunks.size() * chunkBytes(NODE_BYTES, huge_pages) +
+               edge_chunks.size() * chunkBytes(EDGE_BYTES, huge_pages);
+    }
+
+    Index parent(Index index) const { return nodeChunk(index).parents[offsetOf(index)]; }
+    Index firstEdge(Index index) const { return nodeChunk(index).first_edges[offsetOf(index)]; }
+    int numChildren(Index index) const { return nodeChunk(index).num_children[offsetOf(index)]; }
+    int action(Index index) const { return nodeChunk(index).actions[offsetOf(index)]; }
+    float qValue(Index index) const { return nodeChunk(index).q_values[offsetOf(index)]; }
+    int getVisitCount(Index index) const { return nodeChunk(index).visit_counts[offsetOf(index)]; }
+
+    float priorProb(Index index) const
+    {
+        Index edge = nodeChunk(index).edges[offsetOf(index)];
+        return edge == NONE ? 0.0f : edgePriorProb(edge);
+    }
+
+    Index edgeChild(Index edge) const { return edgeChunk(edge).children[offsetOf(edge)]; }
+    int edgeAction(Index edge) const { return edgeChunk(edge).actions[offsetOf(edge)]; }
+
+    float edgePriorProb(Index edge) const
+    {
+        return fromHalf(edgeChunk(edge).prior_probs[offsetOf(edge)]);
+    }
+
+    void setEdgePriorProb(Index edge, float prior_prob)
+    {
+        edgeChunk(edge).prior_probs[offsetOf(edge)] = toHalf(prior_prob);
+    }
+
+    int edgeVisitCount(Index edge) const
+    {
+        Index child = edgeChild(edge);
+        return child == NONE ? 0 : getVisitCount(child);
+    }
+
+    bool isRoot(Index index) const
+    {
+        return parent(index) == NONE;
+    }
+
+    bool isLeaf(Index index) const
+    {
+        return firstEdge(index) == NONE;
+    }
+
+    void update(Index index, float v)
+    {
+        auto &chunk = nodeChunk(index);
+        auto &visit_count = chunk.visit_counts[offsetOf(index)];
+        auto &q_value = chunk.q_values[offsetOf(index)];
+        visit_count++;
+        q_value += (v - q_value) / visit_count;
+    }
+
+    void addVirtualLoss(Index index)
+    {
+        update(index, -1);
+    }
+
+    void revertVirtualLoss(Index index)
+    {
+        auto &chunk = nodeChunk(index);
+        auto &q_value = chunk.q_values[offsetOf(index)];
+        int visit_count = --chunk.visit_counts[offsetOf(index)];
+        q_value = visit_count > 0 ? (q_value * (visit_count + 1) + 1) / visit_count : 0;
+    }
+
+    float value(Index index, int parent_visit_count, float c_puct) const
+    {
+        return qValue(index) + c_puct * priorProb(index) *
+                                   std::sqrt(static_cast<float>(parent_visit_count)) /
+                                   (1 + getVisitCount(index));
+    }
+
+    Index select(Index index, float c_puct)
+    {
+        // NOTE: scan the dense edge range, unvisited edges have Q = 0 and N = 0,
+        //  the selected child is materialised on its first visit,
+        //  returns NONE if the budget refuses to materialise it
+        assertMsg(!isLeaf(index), "Leaf node has no child to select");
+        float scale = c_puct * std::sqrt(static_cast<float>(getVisitCount(index)));
+        Index first = firstEdge(index);
+        const auto &chunk = edgeChunk(first);
+        Index begin = offsetOf(first), end = begin + numChildren(index);
+        Index selected_edge = NONE;
+        float best_value = std::numeric_limits<float>::lowest();
+        for (Index edge = begin; edge < end; ++edge)
+        {
+            float value = scale * fromHalf(chunk.prior_probs[edge]);
+            Index child = chunk.children[edge];
+            if (child != NONE)
+            {
+                const auto &child_chunk = nodeChunk(child);
+                value = child_chunk.q_values[offsetOf(child)] +
+                        value / (1 + child_chunk.visit_counts[offsetOf(child)]);
+            }
+            if (value > best_value)
+            {
+                best_value = value;
+                selected_edge = edge;
+            }
+        }
+        selected_edge += first - begin;
+        Index child = edgeChild(selected_edge);
+        return child != NONE ? child : materialise(index, selected_edge);
+    }
+
+    template <typename Actions>
+    bool expand(Index index, const Actions &valid_actions, const float *prior_probs)
+    {
+        // NOTE: returns false if the budget is exhausted, index stays a leaf
+        assertMsg(isLeaf(index), "Cannot expand a node twice");
+        if (valid_actions.empty())
+            return true;
+        int num_actions = valid_actions.size();
+        Index first = allocateEdges(num_actions, true);
+        if (first == NONE)
+            return false;
+        auto &chunk = edgeChunk(first);
+        for (int i = 0; i < num_actions; ++i)
+        {
+            Index offset = offsetOf(first + i);
+            chunk.children[offset] = NONE;
+            chunk.actions[offset] = valid_actions[i];
+            chunk.prior_probs[offset] = toHalf(prior_probs[valid_actions[i]]);
+        }
+        auto &node_chunk = nodeChunk(index);
+        node_chunk.first_edges[offsetOf(index)] = first;
+        node_chunk.num_children[offsetOf(index)] = num_actions;
+        return true;
+    }
+
+    Index findChild(Index index, int action) const
+    {
+        // NOTE: NONE if the child is not materialised
+        if (isLeaf(index))
+            return NONE;
+        Index first = firstEdge(index), last = first + numChildren(index);
+        for (Index edge = first; edge < last; ++edge)
+            if (edgeAction(edge) == action)
+                return edgeChild(edge);
+        return NONE;
+    }
+
+    Index compact(Index new_root)
+    {
+        // NOTE: move the subtree of new_root to the front of the arena,
+        //  the rest of the tree is discarded and new_root becomes index 0.
+        //  Materialised nodes are laid out in BFS order.
+        //  Returns NONE and leaves the arena cleared if the budget is exceeded.
+        struct Edge
+        {
+            Index child;
+            int16_t action;
+            uint16_t prior_prob;
+        };
+        std::vector<Index> origins{new_root};
+        std::vector<Edge> edges;
+        for (size_t i = 0; i < origins.size(); ++i)
+        {
+            Index first = firstEdge(origins[i]);
+            for (Index edge = first; edge < first + numChildren(origins[i]); ++edge)
+            {
+                const auto &chunk = edgeChunk(edge);
+                Index child = chunk.children[offsetOf(edge)];
+                if (child != NONE)
+                {
+                    origins.push_back(child);
+                    child = origins.size() - 1;
+                }
+                edges.push_back(Edge{child, chunk.actions[offsetOf(edge)],
+                                     chunk.prior_probs[offsetOf(edge)]});
+            }
+        }
+
+        std::vector<uint16_t> num_children(origins.size());
+        std::vector<int16_t> actions(origins.size());
+        std::vector<float> q_values(origins.size());
+        std::vector<int32_t> visit_counts(origins.size());
+        for (size_t i = 0; i < origins.size(); ++i)
+        {
+            num_children[i] = numChildren(origins[i]);
+            actions[i] = action(origins[i]);
+            q_values[i] = qValue(origins[i]);
+            visit_counts[i] = getVisitCount(origins[i]);
+        }
+
+        // NOTE: nodes are re-allocated in order, thus origin i becomes node i.
+        //  The compacted tree never needs more chunks than the old one,
+        //  except for the padding of edge ranges at the end of a chunk
+        clear();
+        for (size_t i = 0; i < origins.size(); ++i)
+            if (allocate(NONE, actions[i], true) == NONE)
+            {
+                clear();
+                return NONE;
+            }
+        size_t next_edge = 0;
+        for (Index index = 0; index < static_cast<Index>(origins.size()); ++index)
+        {
+            auto &chunk = nodeChunk(index);
+            chunk.q_values[offsetOf(index)] = q_values[index];
+            chunk.visit_counts[offsetOf(index)] = visit_counts[index];
+            if (num_children[index] == 0)
+                continue;
+            Index first = allocateEdges(num_children[index], true);
+            if (first == NONE)
+            {
+                clear();
+                return NONE;
+            }
+            chunk.first_edges[offsetOf(index)] = first;
+            chunk.num_children[offsetOf(index)] = num_children[index];
+            auto &edge_chunk = edgeChunk(first);
+            for (Index edge = first; edge < first + num_children[index]; ++edge, ++next_edge)
+            {
+                Index child = edges[next_edge].child;
+                edge_chunk.children[offsetOf(edge)] = child;
+                edge_chunk.actions[offsetOf(edge)] = edges[next_edge].action;
+                edge_chunk.prior_probs[offsetOf(edge)] = edges[next_edge].prior_prob;
+                if (child != NONE)
+                {
+                    nodeChunk(child).parents[offsetOf(child)] = index;
+                    nodeChunk(child).edges[offsetOf(child)] = edge;
+                }
+            }
+        }
+        return 0;
+    }
+
+    void display(Index index, float c_puct) const
+    {
+        std::cout << "Total visit count: "
+                  << getVisitCount(index) << std::endl;
+        if (isLeaf(index))
+            return;
+        Index first = firstEdge(index), last = first + numChildren(index);
+        for (Index edge = first; edge < last; ++edge)
+        {
+            Index child = edgeChild(edge);
+            if (child == NONE)
+                continue;
+            std::cout << "  Action: " << action(child) << " ";
+            std::cout << "Visit count: " << getVisitCount(child) << " ";
+            std::cout << "Q value: " << qValue(child) << " ";
+            std::cout << "Value: " << value(child, getVisitCount(index), c_puct) << std::endl;
+        }
+    }
+};
@@ -0,0 +1,205 @@
+#include "envpool/gobang_mcts/node_arena.hpp"
+
+#include <numeric>
+#include <gtest/gtest.h>
+
+static bool expandAll(NodeArena &nodes, NodeArena::Index index, int count)
+{
+    std::vector<int> valid_actions(count);
+    std::iota(valid_actions.begin(), valid_actions.end(), 0);
+    std::vector<float> prior_probs(count, 1.0f / count);
+    return nodes.expand(index, valid_actions, prior_probs.data());
+}
+
+TEST(NodeArenaTest, LazyChildren)
+{
+    NodeArena nodes;
+    auto root = nodes.allocate(NodeArena::NONE, -1);
+    std::vector<int> valid_actions{3, 5, 7};
+    std::vector<float> prior_probs{0, 0, 0, 0.2f, 0, 0.7f, 0, 0.1f};
+    EXPECT_TRUE(nodes.expand(root, valid_actions, prior_probs.data()));
+    EXPECT_EQ(nodes.size(), 1);
+    EXPECT_EQ(nodes.numEdges(), 3);
+    EXPECT_EQ(nodes.findChild(root, 5), NodeArena::NONE);
+    nodes.update(root, 0.0f);
+
+    // the edge with the highest prior is materialised on its first visit
+    auto child = nodes.select(root, 1.0f);
+    EXPECT_EQ(nodes.size(), 2);
+    EXPECT_EQ(nodes.action(child), 5);
+    EXPECT_EQ(nodes.parent(child), root);
+    EXPECT_NEAR(nodes.priorProb(child), 0.7f, 1e-3);
+    EXPECT_EQ(nodes.findChild(root, 5), child);
+    EXPECT_EQ(nodes.select(root, 1.0f), child);
+    EXPECT_EQ(nodes.size(), 2);
+
+    // a lost visit moves the selection to the next edge
+    nodes.update(child, -1.0f);
+    nodes.update(root, 1.0f);
+    auto next_child = nodes.select(root, 1.0f);
+    EXPECT_EQ(nodes.action(next_child), 3);
+    EXPECT_EQ(nodes.size(), 3);
+
+    int visit_count = 0;
+    for (auto edge = nodes.firstEdge(root); edge < nodes.firstEdge(root) + 3; ++edge)
+        visit_count += nodes.edgeVisitCount(edge);
+    EXPECT_EQ(visit_count, 1);
+}
+
+TEST(NodeArenaTest, Growth)
+{
+    for (bool huge_pages : {false, true})
+    {
+        NodeArena nodes(0, huge_pages);
+        auto node = nodes.allocate(NodeArena::NONE, -1);
+        // NOTE: edge ranges never cross a chunk
+        int num_children = 225;
+        int max_depth = 2 * NodeArena::CHUNK_SIZE / num_children;
+        for (int depth = 0; depth < max_depth; ++depth)
+        {
+            ASSERT_TRUE(expandAll(nodes, node, num_children));
+            auto first = nodes.firstEdge(node);
+            EXPECT_EQ(first >> NodeArena::CHUNK_BITS,
+                      (first + num_children - 1) >> NodeArena::CHUNK_BITS);
+            nodes.update(node, 0.0f);
+            node = nodes.select(node, 1.0f);
+        }
+        EXPECT_GT(nodes.numEdges(), NodeArena::CHUNK_SIZE);
+        EXPECT_EQ(nodes.size(), max_depth + 1);
+        EXPECT_EQ(nodes.peakEdges(), nodes.numEdges());
+
+        // walk back to the root
+        int depth = 0;
+        while (!nodes.isRoot(node))
+            node = nodes.parent(node), depth++;
+        EXPECT_EQ(node, 0);
+        EXPECT_EQ(depth, max_depth);
+    }
+}
+
+TEST(NodeArenaTest, Budget)
+{
+    // NOTE: the budget only fits a single chunk of nodes & edges
+    NodeArena nodes(NodeArena::CHUNK_SIZE * (NodeArena::NODE_BYTES + NodeArena::EDGE_BYTES));
+    auto node = nodes.allocate(NodeArena::NONE, -1);
+    int num_expanded = 0;
+    while (expandAll(nodes, node, 100))
+    {
+        nodes.update(node, 0.0f);
+        node = nodes.select(node, 1.0f);
+        num_expanded++;
+    }
+    EXPECT_EQ(num_expanded, NodeArena::CHUNK_SIZE / 100);
+    EXPECT_TRUE(nodes.isLeaf(node));
+
+    // smaller expansions still fit in the current chunk
+    int remaining = NodeArena::CHUNK_SIZE - nodes.numEdges();
+    EXPECT_TRUE(expandAll(nodes, node, remaining));
+    EXPECT_EQ(nodes.numEdges(), NodeArena::CHUNK_SIZE);
+
+    // chunks are kept after clear
+    nodes.clear();
+    node = nodes.allocate(NodeArena::NONE, -1);
+    EXPECT_TRUE(expandAll(nodes, node, 100));
+    EXPECT_EQ(nodes.peakEdges(), NodeArena::CHUNK_SIZE);
+}
+
+TEST(NodeArenaTest, MinBudget)
+{
+    // NOTE: the smallest budget fits exactly one chunk of nodes & edges
+    EXPECT_EQ(NodeArena::minBytes(),
+              NodeArena::CHUNK_SIZE * (NodeArena::NODE_BYTES + NodeArena::EDGE_BYTES));
+    EXPECT_GE(NodeArena::minBytes(true), NodeArena::minBytes());
+    NodeArena nodes(NodeArena::minBytes());
+    auto root = nodes.allocate(NodeArena::NONE, -1);
+    EXPECT_TRUE(expandAll(nodes, root, 100));
+    EXPECT_EQ(nodes.capacityBytes(), NodeArena::minBytes());
+#ifndef NDEBUG
+    EXPECT_EXIT(NodeArena(NodeArena::minBytes() - 1), testing::ExitedWithCode(EXIT_FAILURE), "budget");
+#endif
+}
+
+TEST(NodeArenaTest, NodeBudget)
+{
+    // NOTE: the budget only fits a single chunk of nodes & edges
+    NodeArena nodes(NodeArena::CHUNK_SIZE * (NodeArena::NODE_BYTES + NodeArena::EDGE_BYTES));
+    auto root = nodes.allocate(NodeArena::NONE, -1);
+    EXPECT_TRUE(expandAll(nodes, root, 1));
+    for (int i = 1; i < NodeArena::CHUNK_SIZE; ++i)
+        ASSERT_NE(nodes.allocate(NodeArena::NONE, -1, true), NodeArena::NONE);
+    EXPECT_EQ(nodes.allocate(NodeArena::NONE, -1, true), NodeArena::NONE);
+
+    // the child cannot be materialised, its edge stays unvisited
+    EXPECT_EQ(nodes.select(root, 1.0f), NodeArena::NONE);
+    EXPECT_EQ(nodes.edgeChild(nodes.firstEdge(root)), NodeArena::NONE);
+    EXPECT_EQ(nodes.size(), NodeArena::CHUNK_SIZE);
+
+    // the compacted root fits in the kept chunks
+    EXPECT_EQ(nodes.compact(root), 0);
+    EXPECT_EQ(nodes.size(), 1);
+    EXPECT_NE(nodes.select(0, 1.0f), NodeArena::NONE);
+    EXPECT_LE(nodes.capacityBytes(),
+              NodeArena::CHUNK_SIZE * (NodeArena::NODE_BYTES + NodeArena::EDGE_BYTES));
+}
+
+TEST(NodeArenaTest, Compact)
+{
+    NodeArena nodes;
+    auto root = nodes.allocate(NodeArena::NONE, -1);
+    expandAll(nodes, root, 10);
+    nodes.update(root, 0.0f);
+    auto new_root = nodes.select(root, 1.0f);
+    int new_root_action = nodes.action(new_root);
+
+    // grow a subtree under new_root whose edges span several chunks,
+    //  half of the children are materialised
+    std::vector<NodeArena::Index> frontier{new_root};
+    int subtree_size = 1;
+    for (size_t i = 0; nodes.numEdges() < 2 * NodeArena::CHUNK_SIZE; ++i)
+    {
+        auto node = frontier[i];
+        expandAll(nodes, node, 200);
+        for (int j = 0; j < 100; ++j)
+        {
+            // NOTE: with c_puct = 0, the first unvisited edge is selected
+            auto child = nodes.select(node, 0.0f);
+            EXPECT_EQ(nodes.action(child), j);
+            nodes.update(child, -1.0f);
+            frontier.push_back(child);
+        }
+        subtree_size += 100;
+    }
+    nodes.update(new_root, 0.5f);
+    int visit_count = nodes.getVisitCount(new_root);
+
+    root = nodes.compact(new_root);
+    EXPECT_EQ(root, 0);
+    EXPECT_TRUE(nodes.isRoot(root));
+    EXPECT_EQ(nodes.action(root), new_root_action);
+    EXPECT_EQ(nodes.getVisitCount(root), visit_count);
+    EXPECT_EQ(nodes.size(), subtree_size);
+
+    // check the structure of the compacted subtree
+    int count = 0;
+    std::vector<NodeArena::Index> queue{root};
+    for (size_t i = 0; i < queue.size(); ++i, ++count)
+    {
+        auto node = queue[i];
+        if (nodes.isLeaf(node))
+            continue;
+        auto first = nodes.firstEdge(node);
+        EXPECT_EQ(nodes.numChildren(node), 200);
+        for (int j = 0; j < nodes.numChildren(node); ++j)
+        {
+            EXPECT_EQ(nodes.edgeAction(first + j), j);
+            EXPECT_NEAR(nodes.edgePriorProb(first + j), 1.0f / 200, 1e-5);
+            auto child = nodes.edgeChild(first + j);
+            if (child == NodeArena::NONE)
+                continue;
+            EXPECT_EQ(nodes.parent(child), node);
+            EXPECT_EQ(nodes.action(child), j);
+            queue.push_back(child);
+        }
+    }
+    EXPECT_EQ(count, subtree_size);
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <iostream>
+
+#include "envpool/gobang_mcts/utils.hpp"
+
+template <typename Env>
+class ParallelMCTS
+{
+    // NOTE: tree parallel MCTS, i.e., worker threads share one tree
+    //  node statistics are lock-free atomics, virtual loss keeps the threads
+    //  on different paths, and an expansion is claimed by a CAS on first_children.
+    //  Each thread owns a copy of Env and of the evaluator, which is called as
+    //  float evaluator(Env &env, std::vector<float> &prior_probs).
+    //  Unlike MCTS, the leaves are evaluated in C++ and the tree is not reused.
+private:
+    using Index = int32_t;
+    static const Index NONE = -1;
+    static const Index EXPANDING = -2;
+
+    template <typename Evaluator, typename = void>
+    struct HasStream : std::false_type
+    {
+    };
+
+    template <typename Evaluator>
+    struct HasStream<Evaluator, std::void_t<decltype(std::declval<Evaluator &>().setStream(0u))>>
+        : std::true_type
+    {
+    };
+
+    const float c_puct;
+    const int num_search;
+    const Index capacity;
+
+    // NOTE: num_children, actions and prior_probs are written before
+    //  first_children is published (release), and read after it is loaded (acquire)
+    std::unique_ptr<std::atomic<Index>[]> first_children;
+    std::unique_ptr<uint16_t[]> num_children;
+    std::unique_ptr<int16_t[]> actions;
+    std::unique_ptr<float[]> prior_probs;
+    std::unique_ptr<std::atomic<int32_t>[]> visit_counts;
+    std::unique_ptr<std::atomic<int32_t>[]> virtual_losses;
+    std::unique_ptr<std::atomic<float>[]> value_sums;
+    std::atomic<Index> allocated_count;
+    std::atomic<int> started_search;
+
+    // NOTE: env always holds the root position, worker threads copy it
+    Index root;
+    Env env;
+
+    Index allocate(int count)
+    {
+        Index first = allocated_count.fetch_add(count);
+        if (first + count > capacity)
+            return NONE;
+        for (Index index = first; index < first + count; ++index)
+        {
+            first_children[index].store(NONE, std::memory_order_relaxed);
+            num_children[index] = 0;
+            visit_counts[index].store(0, std::memory_order_relaxed);
+            virtual_losses[index].store(0, std::memory_order_relaxed);
+            value_sums[index].store(0, std::memory_order_relaxed);
+        }
+        return first;
+    }
+
+    void resetTree()
+    {
+        allocated_count = 0;
+        root = allocate(1);
+        actions[root] = -1;
+        prior_probs[root] = 0;
+    }
+
+    static void atomicAdd(std::atomic<float> &target, float v)
+    {
+        float current = target.load(std::memory_order_relaxed);
+        while (!target.compare_exchange_weak(current, current + v,
+                                             std::memory_order_relaxed))
+            ;
+    }
+
+    Index select(Index index, Index first) const
+    {
+        int parent_visit_count = visit_counts[index].load(std::memory_order_relaxed) +
+                                 virtual_losses[index].load(std::memory_order_relaxed);
+        float scale = c_puct * std::sqrt(static_cast<float>(parent_visit_count));
+        Index selected_child = NONE;
+        float best_value = std::numeric_limits<float>::lowest();
+        for (Index child = first; child < first + num_children[index]; ++child)
+        {
+            // NOTE: each virtual loss counts as a lost visit
+            int virtual_loss = virtual_losses[child].load(std::memory_order_relaxed);
+            int visit_count = visit_counts[child].load(std::memory_order_relaxed) + virtual_loss;
+            float q_value = visit_count > 0
+                                ? (value_sums[child].load(std::memory_order_relaxed) - virtual_loss) / visit_count
+                                : 0;
+            float value = q_value + scale * prior_probs[child] / (1 + visit_count);
+            if (value > best_value)
+            {
+                best_value = value;
+                selected_child = child;
+            }
+        }
+        return selected_child;
+    }
+
+    template <typename Actions>
+    void expand(Index index, const Actions &valid_actions, const std::vector<float> &prior_probs)
+    {
+        // NOTE: the caller has claimed index (first_children == EXPANDING),
+        //  it is released as a leaf if the arena is full
+        int num_actions = valid_actions.size();
+        Index first = num_actions == 0 ? NONE : allocate(num_actions);
+        if (first == NONE)
+        {
+            first_children[index].store(NONE, std::memory_order_release);
+            return;
+        }
+        for (int i = 0; i < num_actions; ++i)
+        {
+            actions[first + i] = valid_actions[i];
+            this->prior_probs[first + i] = prior_probs[valid_actions[i]];
+        }
+        num_children[index] = num_actions;
+        first_children[index].store(first, std::memory_order_release);
+    }
+
+    void revertVirtualLoss(const std::vector<Index> &path)
+    {
+        for (auto index : path)
+            virtual_losses[index].fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void backPropagate(const std::vector<Index> &path, float value)
+    {
+        for (auto it = path.rbegin(); it != path.rend(); ++it)
+        {
+            atomicAdd(value_sums[*it], value);
+            visit_counts[*it].fetch_add(1, std::memory_order_relaxed);
+            virtual_losses[*it].fetch_sub(1, std::memory_order_relaxed);
+            value = -value;
+        }
+    }
+
+    static void rewind(Env &thread_env, const std::vector<Index> &path)
+    {
+        // NOTE: undo the moves along path, i.e., back to the root
+        for (size_t i = 1; i < path.size(); ++i)
+            thread_env.undo();
+    }
+
+    template <typename Evaluator>
+    void simulate(Env &thread_env, Evaluator &evaluator,
+                  std::vector<Index> &path, std::vector<float> &prior_probs)
+    {
+        while (true)
+        {
+            // MCTS: select
+            path.clear();
+            Index node = root, first;
+            while (true)
+            {
+                path.push_back(node);
+                virtual_losses[node].fetch_add(1, std::memory_order_relaxed);
+                first = first_children[node].load(std::memory_order_acquire);
+                if (first < 0)
+                    break;
+                node = select(node, first);
+                thread_env.step(actions[node]);
+            }
+
+            // NOTE: retry if another thread is expanding this leaf
+            if (first == EXPANDING)
+            {
+                revertVirtualLoss(path);
+                rewind(thread_env, path);
+                std::this_thread::yield();
+                continue;
+            }
+
+            float value;
+            Index expected = NONE;
+            auto result = thread_env.checkFinished();
+            if (result.first)
+                value = result.second == -1 ? 0.0f : 1.0f;
+            else if (first_children[node].compare_exchange_strong(expected, EXPANDING))
+            {
+                // MCTS: evaluate & expand
+                value = evaluator(thread_env, prior_probs);
+                expand(node, thread_env.getActions(), prior_probs);
+            }
+            else
+            {
+                revertVirtualLoss(path);
+                rewind(thread_env, path);
+                continue;
+            }
+
+            // MCTS: back propagate
+            backPropagate(path, value);
+            rewind(thread_env, path);
+            return;
+        }
+    }
+
+public:
+    ParallelMCTS(float c_puct, int num_search, const Env &env)
+        : c_puct(c_puct), num_search(num_search),
+          capacity(num_search * env.actionShape() + 1),
+          first_children(new std::atomic<Index>[capacity]),
+          num_children(new uint16_t[capacity]),
+          actions(new int16_t[capacity]),
+          prior_probs(new float[capacity]),
+          visit_counts(new std::atomic<int32_t>[capacity]),
+          virtual_losses(new std::atomic<int32_t>[capacity]),
+          value_sums(new std::atomic<float>[capacity]),
+          env(env)
+    {
+        assertMsg(num_search > 0, "num_search must be positive");
+        resetTree();
+    }
+
+    template <typename Evaluator>
+    void search(int num_threads, const Evaluator &evaluator)
+    {
+        // NOTE: run num_search simulations with num_threads workers,
+        //  each worker evaluates with its own copy of evaluator.
+        //  Evaluators with setStream(uint32_t) (e.g., RolloutEvaluator) are reseeded by worker index,
+        //  otherwise the copies must be stateless, or all workers would repeat the same evaluations
+        assertMsg(num_threads > 0, "num_threads must be positive");
+        started_search = 0;
+        auto worker = [&](int thread_id)
+        {
+            Env thread_env(env);
+            Evaluator thread_evaluator(evaluator);
+            if constexpr (HasStream<Evaluator>::value)
+                thread_evaluator.setStream(thread_id);
+            std::vector<Index> path;
+            std::vector<float> prior_probs(env.actionShape());
+            while (started_search.fetch_add(1) < num_search)
+                simulate(thread_env, thread_evaluator, path, prior_probs);
+        };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < num_threads; ++i)
+            threads.emplace_back(worker, i);
+        worker(0);
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    int getVisitCount() const
+    {
+        return visit_counts[root].load();
+    }
+
+    int numNodes() const
+    {
+        return std::min(allocated_count.load(), capacity);
+    }
+
+    std::vector<std::pair<int, int>> getResult() const
+    {
+        std::vector<std::pair<int, int>> actions_visits;
+        Index first = first_children[root].load();
+        if (first < 0)
+            return actions_visits;
+        for (Index child = first; child < first + num_children[root]; ++child)
+            actions_visits.push_back(
+                std::make_pair(actions[child], visit_counts[child].load()));
+        return actions_visits;
+    }
+
+    void step(int action)
+    {
+        env.step(action);
+        resetTree();
+    }
+
+    void display()
+    {
+        env.display();
+        std::cout << "Total visit count: " << getVisitCount() << std::endl;
+        for (const auto &action_visit : getResult())
+        {
+            std::cout << "  Action: " << action_visit.first << " ";
+            std::cout << "Visit count: " << action_visit.second << std::endl;
+        }
+    }
+};
@@ -0,0 +1,40 @@
+#include "envpool/gobang_mcts/parallel_mcts.hpp"
+#include "envpool/gobang_mcts/gobang_env.hpp"
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+
+using GobangParallelMCTS = ParallelMCTS<GobangEnv>;
+
+struct UniformEvaluator
+{
+    float operator()(GobangEnv &, std::vector<float> &prior_probs)
+    {
+        std::fill(prior_probs.begin(), prior_probs.end(), 1.0f / prior_probs.size());
+        return 0.0f;
+    }
+};
+
+static void BM_ParallelSearch(benchmark::State &state)
+{
+    // NOTE: simulations/sec of a 15x15 opening search, args: num_threads
+    int num_threads = state.range(0);
+    int num_search = 20000;
+    GobangEnv env(15, 5);
+    env.reset();
+    for (auto _ : state)
+    {
+        GobangParallelMCTS mcts(1.0, num_search, env);
+        mcts.search(num_threads, UniformEvaluator());
+        benchmark::DoNotOptimize(mcts.getVisitCount());
+    }
+    state.counters["simulations/s"] = benchmark::Counter(
+        static_cast<double>(num_search) * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_ParallelSearch)
+    ->RangeMultiplier(2)
+    ->Range(1, 32)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
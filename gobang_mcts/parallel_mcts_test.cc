@@ -0,0 +1,82 @@
+#include "envpool/gobang_mcts/parallel_mcts.hpp"
+#include "envpool/gobang_mcts/gobang_env.hpp"
+
+#include <set>
+#include <mutex>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <gtest/gtest.h>
+
+using GobangParallelMCTS = ParallelMCTS<GobangEnv>;
+
+struct UniformEvaluator
+{
+    float operator()(GobangEnv &, std::vector<float> &prior_probs)
+    {
+        std::fill(prior_probs.begin(), prior_probs.end(), .1f);
+        return 0.0f;
+    }
+};
+
+struct StreamEvaluator
+{
+    // NOTE: records the stream of each copy
+    std::shared_ptr<std::mutex> mutex = std::make_shared<std::mutex>();
+    std::shared_ptr<std::set<uint32_t>> streams = std::make_shared<std::set<uint32_t>>();
+
+    void setStream(uint32_t stream)
+    {
+        std::lock_guard<std::mutex> lock(*mutex);
+        streams->insert(stream);
+    }
+
+    float operator()(GobangEnv &, std::vector<float> &prior_probs)
+    {
+        std::fill(prior_probs.begin(), prior_probs.end(), .1f);
+        return 0.0f;
+    }
+};
+
+TEST(ParallelMCTSTest, Search)
+{
+    GobangEnv env(8, 5);
+    env.reset();
+    for (auto action : {0, 8, 1, 9, 2, 10, 3})
+        env.step(action);
+
+    int num_search = 2000;
+    for (int num_threads : {1, 4})
+    {
+        GobangParallelMCTS mcts(1.0, num_search, env);
+        mcts.search(num_threads, UniformEvaluator());
+        EXPECT_EQ(mcts.getVisitCount(), num_search);
+        auto result = mcts.getResult();
+        EXPECT_EQ(result.size(), 8 * 8 - 7);
+        auto visit_count = std::accumulate(
+            result.begin(), result.end(), 0,
+            [](int sum, const std::pair<int, int> &p)
+            { return sum + p.second; });
+        EXPECT_EQ(visit_count, num_search - 1); // the 1st visit expands root
+        auto best = std::max_element(
+            result.begin(), result.end(),
+            [](const std::pair<int, int> &a, const std::pair<int, int> &b)
+            { return a.second < b.second; });
+        EXPECT_EQ(best->first, 4);
+
+        mcts.step(best->first);
+        EXPECT_TRUE(mcts.getResult().empty());
+    }
+}
+
+TEST(ParallelMCTSTest, EvaluatorStream)
+{
+    // NOTE: each worker reseeds its copy of the evaluator with a distinct stream
+    GobangEnv env(8, 5);
+    env.reset();
+    StreamEvaluator evaluator;
+    GobangParallelMCTS mcts(1.0, 200, env);
+    mcts.search(4, evaluator);
+    EXPECT_EQ(*evaluator.streams, std::set<uint32_t>({0, 1, 2, 3}));
+    EXPECT_EQ(mcts.getVisitCount(), 200);
+}
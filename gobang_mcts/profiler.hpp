@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <cstdint>
+
+#if defined(GOBANG_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+namespace Profile
+{
+    // NOTE: HACK: why do we need Profile?
+    // When throughput drops, we want to know where the time of each env goes.
+    //  Timers read the TSC (steady_clock elsewhere) and are compiled out
+    //  unless GOBANG_PROFILE is defined, i.e., now() returns 0 and record() is empty.
+    //  Counters of SearchCounters are always maintained, they are plain increments.
+    enum Phase
+    {
+        SELECT,   // descend the tree, incl. undoing the previous path
+        TERMINAL, // checkFinished() of the selected leaf
+        EXPAND,   // expansions, incl. transpositions
+        BACKPROP, // back propagation & virtual losses
+        EVALUATE, // in-C++ leaf evaluations (see RolloutEvaluator)
+        ENCODE,   // writing the states of pending leaves
+        WAIT,     // between two steps of the envpool, i.e., waiting on python
+        NUM_PHASES
+    };
+
+#ifdef GOBANG_PROFILE
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+
+    inline uint64_t now()
+    {
+#ifdef GOBANG_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+#else
+        return 0;
+#endif
+    }
+
+    inline void record(uint64_t &ticks, uint64_t start)
+    {
+#ifdef GOBANG_PROFILE
+        ticks += now() - start;
+#else
+        (void)ticks;
+        (void)start;
+#endif
+    }
+
+    inline double nanosecondsPerTick()
+    {
+        // NOTE: calibrated once against steady_clock
+#if defined(GOBANG_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+        static const double ns_per_tick = []
+        {
+            auto clock_start = std::chrono::steady_clock::now();
+            uint64_t tick_start = now();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            uint64_t ticks = now() - tick_start;
+            double ns = std::chrono::duration<double, std::nano>(
+                            std::chrono::steady_clock::now() - clock_start)
+                            .count();
+            return ticks > 0 ? ns / ticks : 1.0;
+        }();
+        return ns_per_tick;
+#else
+        return 1.0;
+#endif
+    }
+
+    struct SearchCounters
+    {
+        static constexpr int NUM_COUNTERS = 6;
+
+        int64_t num_simulations = 0;
+        int64_t num_leaves = 0; // leaves to be evaluated, by the network, cache or evaluator
+        int64_t num_terminal_hits = 0;
+        int64_t num_nodes = 0; // cumulative allocations of NodeArena
+        int64_t num_edges = 0;
+        int64_t num_pruned = 0; // simulations skipped by early stops
+        uint64_t ticks[NUM_PHASES] = {};
+
+        SearchCounters &operator+=(const SearchCounters &other)
+        {
+            num_simulations += other.num_simulations;
+            num_leaves += other.num_leaves;
+            num_terminal_hits += other.num_terminal_hits;
+            num_nodes += other.num_nodes;
+            num_edges += other.num_edges;
+            num_pruned += other.num_pruned;
+            for (int i = 0; i < NUM_PHASES; ++i)
+                ticks[i] += other.ticks[i];
+            return *this;
+        }
+
+        void writeCounters(int64_t *output) const
+        {
+            // NOTE: [NUM_COUNTERS], in the order of declaration
+            output[0] = num_simulations;
+            output[1] = num_leaves;
+            output[2] = num_terminal_hits;
+            output[3] = num_nodes;
+            output[4] = num_edges;
+            output[5] = num_pruned;
+        }
+
+        void writeNanoseconds(int64_t *output) const
+        {
+            // NOTE: [NUM_PHASES], all 0 unless GOBANG_PROFILE is defined
+            for (int i = 0; i < NUM_PHASES; ++i)
+                output[i] = static_cast<int64_t>(ticks[i] * nanosecondsPerTick());
+        }
+    };
+} // namespace Profile
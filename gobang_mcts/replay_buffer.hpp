@@ -0,0 +1,436 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "envpool/gobang_mcts/utils.hpp"
+
+namespace Replay
+{
+    // NOTE: HACK: why do we need replay shards?
+    // Self-play samples used to travel envpool -> python -> disk, copying every sample twice.
+    //  Finished games are now appended by C++ to memory-mapped shard files,
+    //  which the trainer maps read-only (see ReplayReader and replay_utils.py).
+    //
+    // A shard is <prefix>-<index>.bin, a 64-byte Header followed by capacity fixed-size records.
+    //  A shard is created & initialised under a temporary name, then linked into place,
+    //  records are only appended, num_records is published after the records are written,
+    //  thus readers never see partial shards or records. A record is one move:
+    //      int16 player, winner (-1 for draw), move, num_actions
+    //      uint64 state[2P + 1][ceil(N * N / 64)]   bit-packed training state (see GobangBoard::encode)
+    //      uint16 actions[max_actions], visits[max_actions]   sparse visit counts, most visited first
+    //  padded to 8 bytes. Visits beyond max_actions are dropped, counts saturate at 65535.
+    static constexpr char MAGIC[8] = {'G', 'B', 'R', 'E', 'P', 'L', 'A', 'Y'};
+    static constexpr uint32_t VERSION = 1;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t board_size;
+        uint32_t num_player_planes;
+        uint32_t max_actions;
+        uint32_t record_size;
+        uint32_t reserved;
+        uint64_t capacity;
+        uint64_t num_records;
+        char padding[16];
+    };
+    static_assert(sizeof(Header) == 64, "Replay header must be 64 bytes");
+
+    struct RecordMeta
+    {
+        int16_t player;
+        int16_t winner;
+        int16_t move;
+        int16_t num_actions;
+    };
+
+    inline int numWords(int board_size)
+    {
+        return (board_size * board_size + 63) / 64;
+    }
+
+    inline size_t recordSize(int board_size, int num_player_planes, int max_actions)
+    {
+        size_t size = sizeof(RecordMeta) +
+                      (num_player_planes * 2 + 1) * numWords(board_size) * sizeof(uint64_t) +
+                      2 * max_actions * sizeof(uint16_t);
+        return (size + 7) / 8 * 8;
+    }
+
+    inline std::string shardPath(const std::string &prefix, int index)
+    {
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), "-%05d.bin", index);
+        return prefix + suffix;
+    }
+
+    inline bool fileExists(const std::string &path)
+    {
+        struct stat buffer;
+        return ::stat(path.c_str(), &buffer) == 0;
+    }
+
+    struct Shard
+    {
+        char *data = nullptr;
+        size_t bytes = 0;
+
+        Header *header() const { return reinterpret_cast<Header *>(data); }
+        char *record(uint64_t i, size_t record_size) const
+        {
+            return data + sizeof(Header) + i * record_size;
+        }
+
+        uint64_t numRecords() const
+        {
+            return __atomic_load_n(&header()->num_records, __ATOMIC_ACQUIRE);
+        }
+
+        void unmap()
+        {
+            if (data != nullptr)
+                munmap(data, bytes);
+            data = nullptr;
+        }
+    };
+} // namespace Replay
+
+class ReplayWriter
+{
+    // NOTE: shared by all envs of the process that write to the same prefix,
+    //  games are appended under a single mutex, new shards never overwrite existing files
+private:
+    const std::string prefix;
+    const int board_size, num_player_planes, max_actions;
+    const uint64_t shard_capacity;
+    const size_t record_size;
+    std::mutex mutex;
+    Replay::Shard shard;
+    int shard_index;
+    uint64_t num_records;
+    int64_t num_games;
+    std::vector<std::pair<int, int>> sorted_visits;
+
+    void openShard()
+    {
+        shard.unmap();
+        std::string temp_path = prefix + "-XXXXXX.tmp";
+        int fd = ::mkstemps(&temp_path[0], 4);
+        if (fd < 0)
+            throw std::runtime_error("Cannot create replay shard " + temp_path);
+        ::fchmod(fd, 0644);
+        shard.bytes = sizeof(Replay::Header) + shard_capacity * record_size;
+        if (::ftruncate(fd, shard.bytes) != 0)
+        {
+            ::close(fd);
+            ::unlink(temp_path.c_str());
+            throw std::runtime_error("Cannot resize replay shard " + temp_path);
+        }
+        void *data = mmap(nullptr, shard.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            ::unlink(temp_path.c_str());
+            throw std::runtime_error("Cannot map replay shard " + temp_path);
+        }
+        shard.data = static_cast<char *>(data);
+
+        auto *header = shard.header();
+        std::memcpy(header->magic, Replay::MAGIC, sizeof(Replay::MAGIC));
+        header->version = Replay::VERSION;
+        header->board_size = board_size;
+        header->num_player_planes = num_player_planes;
+        header->max_actions = max_actions;
+        header->record_size = record_size;
+        header->capacity = shard_capacity;
+        header->num_records = 0;
+        num_records = 0;
+
+        // NOTE: link() never overwrites an existing shard, unlike rename()
+        while (::link(temp_path.c_str(), Replay::shardPath(prefix, shard_index).c_str()) != 0)
+        {
+            if (errno != EEXIST)
+            {
+                ::unlink(temp_path.c_str());
+                shard.unmap();
+                throw std::runtime_error("Cannot link replay shard " + Replay::shardPath(prefix, shard_index));
+            }
+            shard_index++;
+        }
+        ::unlink(temp_path.c_str());
+    }
+
+    void writeRecord(char *record, const uint64_t *state, const std::pair<int, int> *visits,
+                     int num_visits, int player, int winner, int move)
+    {
+        // NOTE: keep the max_actions most visited actions
+        sorted_visits.assign(visits, visits + num_visits);
+        int num_actions = std::min(num_visits, max_actions);
+        std::partial_sort(sorted_visits.begin(), sorted_visits.begin() + num_actions, sorted_visits.end(),
+                          [](const std::pair<int, int> &a, const std::pair<int, int> &b)
+                          { return a.second > b.second; });
+
+        Replay::RecordMeta meta{static_cast<int16_t>(player), static_cast<int16_t>(winner),
+                                static_cast<int16_t>(move), static_cast<int16_t>(num_actions)};
+        std::memcpy(record, &meta, sizeof(meta));
+        size_t state_bytes = (num_player_planes * 2 + 1) * Replay::numWords(board_size) * sizeof(uint64_t);
+        std::memcpy(record + sizeof(meta), state, state_bytes);
+        auto *actions = reinterpret_cast<uint16_t *>(record + sizeof(meta) + state_bytes);
+        auto *counts = actions + max_actions;
+        std::fill(actions, actions + 2 * max_actions, 0);
+        for (int i = 0; i < num_actions; ++i)
+        {
+            actions[i] = sorted_visits[i].first;
+            counts[i] = std::min(sorted_visits[i].second, 65535);
+        }
+    }
+
+public:
+    ReplayWriter(const std::string &prefix, int board_size, int num_player_planes,
+                 int max_actions = 0, uint64_t shard_capacity = 1 << 16)
+        : prefix(prefix), board_size(board_size), num_player_planes(num_player_planes),
+          max_actions(max_actions > 0 ? max_actions : board_size * board_size),
+          shard_capacity(shard_capacity),
+          record_size(Replay::recordSize(board_size, num_player_planes, this->max_actions)),
+          shard_index(0), num_records(0), num_games(0)
+    {
+        assertMsg(shard_capacity > 0, "shard_capacity must be positive");
+        openShard();
+    }
+
+    ReplayWriter(const ReplayWriter &) = delete;
+    ReplayWriter &operator=(const ReplayWriter &) = delete;
+
+    ~ReplayWriter()
+    {
+        shard.unmap();
+    }
+
+    static std::shared_ptr<ReplayWriter> shared(const std::string &prefix, int board_size,
+                                                int num_player_planes, int max_actions = 0,
+                                                uint64_t shard_capacity = 1 << 16)
+    {
+        // NOTE: process-wide instance per prefix, all writers of a prefix share its record layout
+        static std::mutex mutex;
+        static std::map<std::string, std::weak_ptr<ReplayWriter>> writers;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto &writer = writers[prefix];
+        auto instance = writer.lock();
+        if (!instance)
+        {
+            instance = std::make_shared<ReplayWriter>(prefix, board_size, num_player_planes,
+                                                      max_actions, shard_capacity);
+            writer = instance;
+        }
+        if (instance->board_size != board_size || instance->num_player_planes != num_player_planes ||
+            instance->max_actions != (max_actions > 0 ? max_actions : board_size * board_size))
+            throw std::runtime_error("Replay prefix " + prefix + " is already used with another layout");
+        return instance;
+    }
+
+    void appendGame(int length, const uint64_t *states, const std::pair<int, int> *visits,
+                    const int *visit_offsets, const int *players, int winner,
+                    const int *moves = nullptr)
+    {
+        // NOTE: record i has the bit-packed state states[i] and the visit counts
+        //  visits[visit_offsets[i], visit_offsets[i + 1]), its move number is moves[i]
+        //  (i if moves is nullptr), a game may span two shards
+        int state_size = (num_player_planes * 2 + 1) * Replay::numWords(board_size);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < length; ++i)
+        {
+            if (num_records == shard_capacity)
+            {
+                shard_index++;
+                openShard();
+            }
+            writeRecord(shard.record(num_records, record_size), states + i * state_size,
+                        visits + visit_offsets[i], visit_offsets[i + 1] - visit_offsets[i],
+                        players[i], winner, moves == nullptr ? i : moves[i]);
+            num_records++;
+            __atomic_store_n(&shard.header()->num_records, num_records, __ATOMIC_RELEASE);
+        }
+        num_games++;
+    }
+
+    int64_t numGames()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return num_games;
+    }
+
+    size_t recordSize() const { return record_size; }
+};
+
+class ReplayReader
+{
+    // NOTE: maps all shards of a prefix read-only, refresh() picks up new records & shards
+private:
+    const std::string prefix;
+    std::vector<Replay::Shard> shards;
+    std::vector<uint64_t> cumulative_records;
+    int board_size, num_player_planes, max_actions;
+    size_t record_size;
+
+    bool mapShard(const std::string &path)
+    {
+        // NOTE: returns false for a shard with a short or zeroed header,
+        //  e.g., created by a writer of an older version, retried by the next refresh()
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open replay shard " + path);
+        struct stat buffer;
+        if (::fstat(fd, &buffer) != 0 || buffer.st_size < static_cast<off_t>(sizeof(Replay::Header)))
+        {
+            ::close(fd);
+            return false;
+        }
+        Replay::Shard shard;
+        shard.bytes = buffer.st_size;
+        void *data = mmap(nullptr, shard.bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("Cannot map replay shard " + path);
+        shard.data = static_cast<char *>(data);
+
+        const auto *header = shard.header();
+        static constexpr char ZEROS[sizeof(Replay::MAGIC)] = {};
+        if (std::memcmp(header->magic, ZEROS, sizeof(ZEROS)) == 0 ||
+            shard.bytes < sizeof(Replay::Header) + header->capacity * header->record_size)
+        {
+            shard.unmap();
+            return false;
+        }
+        if (std::memcmp(header->magic, Replay::MAGIC, sizeof(Replay::MAGIC)) != 0 ||
+            header->version != Replay::VERSION)
+        {
+            shard.unmap();
+            throw std::runtime_error("Not a replay shard " + path);
+        }
+        if (shards.empty())
+        {
+            board_size = header->board_size;
+            num_player_planes = header->num_player_planes;
+            max_actions = header->max_actions;
+            record_size = header->record_size;
+        }
+        else if (header->record_size != record_size ||
+                 header->board_size != static_cast<uint32_t>(board_size))
+        {
+            shard.unmap();
+            throw std::runtime_error("Mismatched replay shard " + path);
+        }
+        shards.push_back(shard);
+        return true;
+    }
+
+    const char *record(uint64_t i) const
+    {
+        int k = std::upper_bound(cumulative_records.begin(), cumulative_records.end(), i) -
+                cumulative_records.begin();
+        uint64_t offset = k == 0 ? i : i - cumulative_records[k - 1];
+        return shards[k].record(offset, record_size);
+    }
+
+    Replay::RecordMeta meta(uint64_t i) const
+    {
+        Replay::RecordMeta meta;
+        std::memcpy(&meta, record(i), sizeof(meta));
+        return meta;
+    }
+
+public:
+    explicit ReplayReader(const std::string &prefix)
+        : prefix(prefix), board_size(0), num_player_planes(0), max_actions(0), record_size(0)
+    {
+        refresh();
+    }
+
+    ReplayReader(const ReplayReader &) = delete;
+    ReplayReader &operator=(const ReplayReader &) = delete;
+
+    ~ReplayReader()
+    {
+        for (auto &shard : shards)
+            shard.unmap();
+    }
+
+    void refresh()
+    {
+        while (Replay::fileExists(Replay::shardPath(prefix, shards.size())))
+            if (!mapShard(Replay::shardPath(prefix, shards.size())))
+                break;
+        cumulative_records.resize(shards.size());
+        uint64_t total = 0;
+        for (size_t k = 0; k < shards.size(); ++k)
+            cumulative_records[k] = total += shards[k].numRecords();
+    }
+
+    uint64_t size() const
+    {
+        return cumulative_records.empty() ? 0 : cumulative_records.back();
+    }
+
+    int numShards() const { return shards.size(); }
+    int boardSize() const { return board_size; }
+    int numPlayerPlanes() const { return num_player_planes; }
+
+    template <typename Rng>
+    uint64_t sample(Rng &rng) const
+    {
+        // NOTE: uniform over the records of all shards
+        assertMsg(size() > 0, "Replay is empty");
+        return std::uniform_int_distribution<uint64_t>(0, size() - 1)(rng);
+    }
+
+    int player(uint64_t i) const { return meta(i).player; }
+    int winner(uint64_t i) const { return meta(i).winner; }
+    int move(uint64_t i) const { return meta(i).move; }
+
+    const uint64_t *packedState(uint64_t i) const
+    {
+        return reinterpret_cast<const uint64_t *>(record(i) + sizeof(Replay::RecordMeta));
+    }
+
+    template <typename T>
+    void decodeState(uint64_t i, T *output) const
+    {
+        // NOTE: [2P + 1, N, N] planes, the same as GobangEnv::writeState()
+        int flatten_size = board_size * board_size, num_words = Replay::numWords(board_size);
+        const uint64_t *state = packedState(i);
+        for (int k = 0; k < num_player_planes * 2 + 1; ++k)
+            for (int j = 0; j < flatten_size; ++j)
+                output[k * flatten_size + j] = state[k * num_words + j / 64] >> (j % 64) & 1;
+    }
+
+    void decodeVisits(uint64_t i, int *visit_counts) const
+    {
+        // NOTE: dense [N * N], 0 for actions that are not stored
+        auto record_meta = meta(i);
+        int num_words = Replay::numWords(board_size);
+        const auto *actions = reinterpret_cast<const uint16_t *>(
+            packedState(i) + (num_player_planes * 2 + 1) * num_words);
+        const auto *counts = actions + max_actions;
+        std::fill(visit_counts, visit_counts + board_size * board_size, 0);
+        for (int j = 0; j < record_meta.num_actions; ++j)
+            visit_counts[actions[j]] = counts[j];
+    }
+};
@@ -0,0 +1,133 @@
+#include "envpool/gobang_mcts/replay_buffer.hpp"
+
+#include <random>
+#include <cstdlib>
+#include <gtest/gtest.h>
+
+static std::string tempPrefix()
+{
+    char directory[] = "/tmp/replay_test_XXXXXX";
+    EXPECT_NE(mkdtemp(directory), nullptr);
+    return std::string(directory) + "/games";
+}
+
+TEST(ReplayBufferTest, WriteRead)
+{
+    // NOTE: 3 x 3 board, one word per plane, 3 planes,
+    //  the bits beyond the board are kept but not decoded
+    auto prefix = tempPrefix();
+    int length = 5;
+    std::vector<uint64_t> states;
+    std::vector<std::pair<int, int>> visits;
+    std::vector<int> offsets{0}, players;
+    for (int i = 0; i < length; ++i)
+    {
+        for (int k = 0; k < 3; ++k)
+            states.push_back((1ull << i) | (k << 16));
+        for (int action = 0; action < 9; ++action)
+            visits.emplace_back(action, action == i ? 100 : action);
+        offsets.push_back(visits.size());
+        players.push_back(i % 2);
+    }
+    {
+        // NOTE: only 4 actions per record, 3 records per shard
+        ReplayWriter writer(prefix, 3, 1, 4, 3);
+        writer.appendGame(length, states.data(), visits.data(), offsets.data(), players.data(), 0);
+        writer.appendGame(length, states.data(), visits.data(), offsets.data(), players.data(), -1);
+        EXPECT_EQ(writer.numGames(), 2);
+    }
+
+    ReplayReader reader(prefix);
+    EXPECT_EQ(reader.size(), 2 * length);
+    EXPECT_EQ(reader.numShards(), 4);
+    EXPECT_EQ(reader.boardSize(), 3);
+    std::vector<int> state(3 * 9), visit_counts(9);
+    for (int i = 0; i < 2 * length; ++i)
+    {
+        int move = i % length;
+        EXPECT_EQ(reader.move(i), move);
+        EXPECT_EQ(reader.player(i), move % 2);
+        EXPECT_EQ(reader.winner(i), i < length ? 0 : -1);
+        EXPECT_EQ(reader.packedState(i)[2], (1ull << move) | (2 << 16));
+        reader.decodeState(i, state.data());
+        for (int k = 0; k < 3; ++k)
+            for (int j = 0; j < 9; ++j)
+                EXPECT_EQ(state[k * 9 + j], j == move ? 1 : 0);
+        // the 4 most visited actions are kept
+        reader.decodeVisits(i, visit_counts.data());
+        for (int action = 0; action < 9; ++action)
+        {
+            int expected = action == move ? 100 : action >= 6 || (move >= 6 && action == 5) ? action : 0;
+            EXPECT_EQ(visit_counts[action], expected);
+        }
+    }
+    std::mt19937 rng(0);
+    for (int i = 0; i < 100; ++i)
+        EXPECT_LT(reader.sample(rng), reader.size());
+}
+
+TEST(ReplayBufferTest, Append)
+{
+    // NOTE: a new writer never overwrites existing shards, readers pick up new records on refresh
+    auto prefix = tempPrefix();
+    std::vector<uint64_t> states(3, 0);
+    std::vector<std::pair<int, int>> visits{{4, 1}};
+    std::vector<int> offsets{0, 1}, players{0};
+    auto writer = ReplayWriter::shared(prefix, 3, 1);
+    EXPECT_EQ(ReplayWriter::shared(prefix, 3, 1), writer);
+    EXPECT_EQ(ReplayWriter::shared(prefix, 3, 1, 9), writer);
+    // the layout of a prefix is fixed by its first writer
+    EXPECT_THROW(ReplayWriter::shared(prefix, 5, 1), std::runtime_error);
+    EXPECT_THROW(ReplayWriter::shared(prefix, 3, 2), std::runtime_error);
+    EXPECT_THROW(ReplayWriter::shared(prefix, 3, 1, 4), std::runtime_error);
+    writer->appendGame(1, states.data(), visits.data(), offsets.data(), players.data(), 0);
+    ReplayReader reader(prefix);
+    EXPECT_EQ(reader.size(), 1);
+    writer->appendGame(1, states.data(), visits.data(), offsets.data(), players.data(), 0);
+    EXPECT_EQ(reader.size(), 1);
+    reader.refresh();
+    EXPECT_EQ(reader.size(), 2);
+
+    writer.reset();
+    ReplayWriter other_writer(prefix, 3, 1);
+    other_writer.appendGame(1, states.data(), visits.data(), offsets.data(), players.data(), 1);
+    reader.refresh();
+    EXPECT_EQ(reader.numShards(), 2);
+    EXPECT_EQ(reader.size(), 3);
+    EXPECT_EQ(reader.winner(2), 1);
+}
+
+TEST(ReplayBufferTest, PartialShard)
+{
+    // NOTE: readers stop at a shard with a short or zeroed header instead of throwing
+    auto prefix = tempPrefix();
+    auto path = Replay::shardPath(prefix, 0);
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    std::fclose(file);
+    ReplayReader reader(prefix);
+    EXPECT_EQ(reader.numShards(), 0);
+
+    char zeros[sizeof(Replay::Header)] = {};
+    file = std::fopen(path.c_str(), "wb");
+    std::fwrite(zeros, 1, sizeof(zeros), file);
+    std::fclose(file);
+    reader.refresh();
+    EXPECT_EQ(reader.numShards(), 0);
+    EXPECT_EQ(reader.size(), 0);
+
+    // the writer skips the existing file, and leaves no temporary file behind
+    std::vector<uint64_t> states(3, 0);
+    std::vector<std::pair<int, int>> visits{{4, 1}};
+    std::vector<int> offsets{0, 1}, players{0};
+    {
+        ReplayWriter writer(prefix, 3, 1);
+        writer.appendGame(1, states.data(), visits.data(), offsets.data(), players.data(), 0);
+    }
+    EXPECT_TRUE(Replay::fileExists(Replay::shardPath(prefix, 1)));
+    std::remove(path.c_str());
+    ASSERT_EQ(std::rename(Replay::shardPath(prefix, 1).c_str(), path.c_str()), 0);
+    reader.refresh();
+    EXPECT_EQ(reader.numShards(), 1);
+    EXPECT_EQ(reader.size(), 1);
+}
@@ -0,0 +1,114 @@
+import os
+
+import numpy as np
+
+from .state_utils import unpack_state
+
+HEADER_SIZE = 64
+MAGIC = b"GBREPLAY"
+VERSION = 1
+HEADER_DTYPE = np.dtype([
+    ("magic", "S8"),
+    ("version", "<u4"),
+    ("board_size", "<u4"),
+    ("num_player_planes", "<u4"),
+    ("max_actions", "<u4"),
+    ("record_size", "<u4"),
+    ("reserved", "<u4"),
+    ("capacity", "<u8"),
+    ("num_records", "<u8"),
+    ("padding", "V16"),
+])
+
+
+def record_dtype(board_size, num_player_planes, max_actions, record_size):
+    """Structured dtype of a replay record, see replay_buffer.hpp."""
+    num_words = (board_size * board_size + 63) // 64
+    state_offset = 8
+    actions_offset = state_offset + (num_player_planes * 2 + 1) * num_words * 8
+    return np.dtype({
+        "names": ["player", "winner", "move", "num_actions",
+                  "state", "actions", "visits"],
+        "formats": ["<i2", "<i2", "<i2", "<i2",
+                    ("<u8", (num_player_planes * 2 + 1, num_words)),
+                    ("<u2", (max_actions, )), ("<u2", (max_actions, ))],
+        "offsets": [0, 2, 4, 6, state_offset,
+                    actions_offset, actions_offset + max_actions * 2],
+        "itemsize": record_size,
+    })
+
+
+class ReplayReader:
+    """Read-only view of the replay shards <prefix>-<index>.bin.
+
+    Records are memory-mapped, only the sampled batch is copied.
+    Call refresh() to pick up the records & shards written since.
+    """
+
+    def __init__(self, prefix):
+        self.prefix = prefix
+        self.headers, self.records = [], []
+        self.cumulative_records = np.zeros(0, dtype=np.int64)
+        self.refresh()
+
+    def _shard_path(self, index):
+        return f"{self.prefix}-{index:05d}.bin"
+
+    def refresh(self):
+        # NOTE: stop at a shard with a short or zeroed header,
+        #  it is picked up by a later refresh()
+        while os.path.exists(self._shard_path(len(self.headers))):
+            path = self._shard_path(len(self.headers))
+            if os.path.getsize(path) < HEADER_SIZE:
+                break
+            header = np.memmap(path, dtype=HEADER_DTYPE, mode="r", shape=(1, ))
+            if header["magic"][0] == b"":
+                break
+            if header["magic"][0] != MAGIC or header["version"][0] != VERSION:
+                raise ValueError(f"Not a replay shard: {path}")
+            self.headers.append(header)
+            self.records.append(np.memmap(
+                path, dtype=self.dtype, mode="r", offset=HEADER_SIZE,
+                shape=(int(header["capacity"][0]), )))
+        self.cumulative_records = np.cumsum(
+            [int(header["num_records"][0]) for header in self.headers], dtype=np.int64)
+
+    @property
+    def board_size(self):
+        return int(self.headers[0]["board_size"][0])
+
+    @property
+    def dtype(self):
+        header = self.headers[-1]
+        return record_dtype(int(header["board_size"][0]), int(header["num_player_planes"][0]),
+                            int(header["max_actions"][0]), int(header["record_size"][0]))
+
+    def __len__(self):
+        return int(self.cumulative_records[-1]) if len(self.headers) else 0
+
+    def __getitem__(self, indices):
+        indices = np.asarray(indices, dtype=np.int64)
+        shards = np.searchsorted(self.cumulative_records, indices, side="right")
+        offsets = indices - np.concatenate([[0], self.cumulative_records])[shards]
+        batch = np.empty(indices.shape, dtype=self.dtype)
+        for k in np.unique(shards):
+            batch[shards == k] = self.records[k][offsets[shards == k]]
+        return batch
+
+    def sample(self, batch_size, rng=np.random):
+        """Uniform over the records of all shards."""
+        return self[rng.randint(0, len(self), size=batch_size)]
+
+    def decode(self, batch):
+        """Dense (state [B, 2P + 1, N, N], visit counts [B, N * N], value [B]),
+        value is the result from the view of the player to move."""
+        board_size = self.board_size
+        states = unpack_state(
+            np.ascontiguousarray(batch["state"]).view(np.uint8), board_size)
+        visits = np.zeros((len(batch), board_size * board_size), dtype=np.int32)
+        mask = np.arange(batch["actions"].shape[-1]) < batch["num_actions"][:, None]
+        rows = np.broadcast_to(np.arange(len(batch))[:, None], mask.shape)
+        visits[rows[mask], batch["actions"][mask]] = batch["visits"][mask]
+        values = np.where(batch["winner"] == -1, 0,
+                          np.where(batch["winner"] == batch["player"], 1, -1))
+        return states, visits, values.astype(np.float32)
@@ -0,0 +1,33 @@
+import numpy as np
+
+
+def unpack_state(state_compact, board_size, state_format="bits"):
+    """Unpack obs:state_compact into 0/1 planes of shape [..., C, N, N].
+
+    state_format is the one given to the envpool, i.e., "uint8" or "bits".
+    With "bits", each plane is ceil(N * N / 64) little-endian uint64 words.
+    """
+    state_compact = np.asarray(state_compact)
+    if state_format == "uint8":
+        return state_compact
+    if state_format != "bits":
+        raise ValueError(f"Unknown state_format: {state_format}")
+    flatten_size = board_size * board_size
+    planes = np.unpackbits(state_compact, axis=-1, bitorder="little")
+    return planes[..., :flatten_size].reshape(
+        *state_compact.shape[:-1], board_size, board_size)
+
+
+def pack_state(state, state_format="bits"):
+    """Inverse of unpack_state, for tests & replay buffers."""
+    state = np.asarray(state)
+    if state_format == "uint8":
+        return state.astype(np.uint8)
+    if state_format != "bits":
+        raise ValueError(f"Unknown state_format: {state_format}")
+    flatten_size = state.shape[-1] * state.shape[-2]
+    num_bytes = (flatten_size + 63) // 64 * 8
+    planes = state.reshape(*state.shape[:-2], flatten_size).astype(np.uint8)
+    packed = np.packbits(planes, axis=-1, bitorder="little")
+    padding = [(0, 0)] * (packed.ndim - 1) + [(0, num_bytes - packed.shape[-1])]
+    return np.pad(packed, padding)
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "envpool/gobang_mcts/utils.hpp"
+
+class Symmetry
+{
+    // NOTE: the 8 dihedral symmetries of a square board,
+    //  symmetry s flips the columns if (s & 4), then rotates (s & 3) times by 90 degrees.
+    //  Permutation tables are built once per board size and shared by all boards.
+public:
+    static const int NUM_SYMMETRIES = 8;
+    static const int MAX_BOARD_SIZE = 32;
+
+    static int transform(int symmetry, int index, int board_size)
+    {
+        int row = index / board_size, col = index % board_size;
+        if (symmetry & 4)
+            col = board_size - 1 - col;
+        for (int i = 0; i < (symmetry & 3); i++)
+        {
+            int temp = row;
+            row = col;
+            col = board_size - 1 - temp;
+        }
+        return row * board_size + col;
+    }
+
+    static int inverse(int symmetry)
+    {
+        // NOTE: flips are involutions, rotations are inverted by the opposite rotation
+        return symmetry & 4 ? symmetry : (4 - symmetry) & 3;
+    }
+
+    static const int *permutations(int board_size)
+    {
+        // NOTE: permutations(board_size)[s * board_size^2 + index] == transform(s, index, board_size)
+        static std::once_flag flags[MAX_BOARD_SIZE + 1];
+        static std::vector<int> tables[MAX_BOARD_SIZE + 1];
+        assertMsg(board_size > 0 && board_size <= MAX_BOARD_SIZE,
+                  "Invalid board size " + std::to_string(board_size));
+        std::call_once(flags[board_size], [board_size]()
+                       {
+            auto &table = tables[board_size];
+            int flatten_size = board_size * board_size;
+            table.resize(NUM_SYMMETRIES * flatten_size);
+            for (int s = 0; s < NUM_SYMMETRIES; s++)
+                for (int i = 0; i < flatten_size; i++)
+                    table[s * flatten_size + i] = transform(s, i, board_size); });
+        return tables[board_size].data();
+    }
+
+    template <typename T>
+    static void transformPlanes(int symmetry, int board_size, int num_planes,
+                                const T *input, T *output)
+    {
+        // NOTE: output[transform(symmetry, index)] = input[index] on each plane,
+        //  e.g., state planes [C, N, N] or visit counts [1, N * N]
+        int flatten_size = board_size * board_size;
+        const int *permutation = permutations(board_size) + symmetry * flatten_size;
+        for (int k = 0; k < num_planes; k++, input += flatten_size, output += flatten_size)
+            for (int i = 0; i < flatten_size; i++)
+                output[permutation[i]] = input[i];
+    }
+};
@@ -0,0 +1,48 @@
+#include "envpool/gobang_mcts/symmetry.hpp"
+
+#include <set>
+#include <gtest/gtest.h>
+
+TEST(SymmetryTest, Group)
+{
+    for (int board_size : {1, 3, 8, 15})
+    {
+        int flatten_size = board_size * board_size;
+        const int *permutations = Symmetry::permutations(board_size);
+        std::set<std::vector<int>> distinct;
+        for (int s = 0; s < Symmetry::NUM_SYMMETRIES; s++)
+        {
+            std::vector<int> permutation(permutations + s * flatten_size,
+                                         permutations + (s + 1) * flatten_size);
+            distinct.insert(permutation);
+            std::set<int> image(permutation.begin(), permutation.end());
+            EXPECT_EQ(image.size(), flatten_size);
+            for (int i = 0; i < flatten_size; i++)
+            {
+                EXPECT_EQ(permutation[i], Symmetry::transform(s, i, board_size));
+                EXPECT_EQ(Symmetry::transform(Symmetry::inverse(s), permutation[i], board_size), i);
+            }
+        }
+        EXPECT_EQ(distinct.size(), board_size == 1 ? 1 : Symmetry::NUM_SYMMETRIES);
+    }
+}
+
+TEST(SymmetryTest, TransformPlanes)
+{
+    int board_size = 5, num_planes = 3, flatten_size = board_size * board_size;
+    std::vector<int> planes(num_planes * flatten_size);
+    for (size_t i = 0; i < planes.size(); i++)
+        planes[i] = i;
+    for (int s = 0; s < Symmetry::NUM_SYMMETRIES; s++)
+    {
+        std::vector<int> transformed(planes.size()), restored(planes.size());
+        Symmetry::transformPlanes(s, board_size, num_planes, planes.data(), transformed.data());
+        for (int k = 0; k < num_planes; k++)
+            for (int i = 0; i < flatten_size; i++)
+                EXPECT_EQ(transformed[k * flatten_size + Symmetry::transform(s, i, board_size)],
+                          planes[k * flatten_size + i]);
+        Symmetry::transformPlanes(Symmetry::inverse(s), board_size, num_planes,
+                                  transformed.data(), restored.data());
+        EXPECT_EQ(restored, planes);
+    }
+}
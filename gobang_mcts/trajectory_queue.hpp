@@ -0,0 +1,144 @@
+#pragma once
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <iterator>
+#include <stdexcept>
+#include <algorithm>
+
+#include "envpool/gobang_mcts/utils.hpp"
+
+class TrajectoryQueue
+{
+    // NOTE: HACK: why do we need TrajectoryQueue?
+    // A whole-episode trajectory does not fit the per-step state of envpool,
+    //  every key of the state spec is allocated and sent on every step,
+    //  i.e., ~200 KB per env per step for dense [N * N, N * N] visit counts on 15 x 15.
+    //  Finished episodes are pushed here instead, and drained out of band
+    //  by drain_trajectories() of the python module, see gobang_envpool.cc.
+    //
+    // There is one process-wide queue per pool name, shared by the envs with emit_trajectory
+    //  and the same trajectory_pool, episodes are tagged with the id of their env.
+    //  A queue keeps the latest capacity episodes, older ones are dropped and counted.
+public:
+    struct Episode
+    {
+        // NOTE: length moves, states: [L, 2P + 1, ceil(N * N / 64)] (bit-packed),
+        //  the visits of move i are visits[visit_offsets[i], visit_offsets[i + 1])
+        int id;
+        int board_size, num_player_planes;
+        int winner;
+        std::vector<uint64_t> states;
+        std::vector<std::pair<int, int>> visits;
+        std::vector<int> visit_offsets;
+        std::vector<int> players;
+        std::vector<int> actions;
+
+        int length() const { return players.size(); }
+    };
+
+private:
+    const size_t capacity;
+    std::mutex mutex;
+    std::deque<Episode> episodes;
+    int64_t num_dropped;
+
+    static std::mutex &registryMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::map<std::string, std::shared_ptr<TrajectoryQueue>> &registry()
+    {
+        static std::map<std::string, std::shared_ptr<TrajectoryQueue>> queues;
+        return queues;
+    }
+
+public:
+    explicit TrajectoryQueue(size_t capacity)
+        : capacity(capacity), num_dropped(0)
+    {
+        assertMsg(capacity > 0, "TrajectoryQueue capacity must be positive");
+    }
+
+    TrajectoryQueue(const TrajectoryQueue &) = delete;
+    TrajectoryQueue &operator=(const TrajectoryQueue &) = delete;
+
+    static std::shared_ptr<TrajectoryQueue> shared(const std::string &pool, size_t capacity)
+    {
+        // NOTE: process-wide instance per pool, all users of a pool agree on its capacity
+        std::lock_guard<std::mutex> lock(registryMutex());
+        auto &instance = registry()[pool];
+        if (!instance)
+            instance = std::make_shared<TrajectoryQueue>(capacity);
+        else if (instance->capacity != capacity)
+            throw std::runtime_error("Trajectory pool " + pool + " is already used with another capacity");
+        return instance;
+    }
+
+    static std::shared_ptr<TrajectoryQueue> find(const std::string &pool)
+    {
+        // NOTE: the queue of pool, nullptr if no env uses it
+        std::lock_guard<std::mutex> lock(registryMutex());
+        auto it = registry().find(pool);
+        return it == registry().end() ? nullptr : it->second;
+    }
+
+    void appendGame(int id, int board_size, int num_player_planes, int length,
+                    const uint64_t *states, const std::pair<int, int> *visits,
+                    const int *visit_offsets, const int *players, const int *actions, int winner)
+    {
+        // NOTE: the same layout as ReplayWriter::appendGame(), copied into a single episode
+        int state_size = (num_player_planes * 2 + 1) * ((board_size * board_size + 63) / 64);
+        Episode episode;
+        episode.id = id;
+        episode.board_size = board_size;
+        episode.num_player_planes = num_player_planes;
+        episode.winner = winner;
+        episode.states.assign(states, states + length * state_size);
+        episode.visits.assign(visits + visit_offsets[0], visits + visit_offsets[length]);
+        episode.visit_offsets.resize(length + 1);
+        for (int i = 0; i <= length; ++i)
+            episode.visit_offsets[i] = visit_offsets[i] - visit_offsets[0];
+        episode.players.assign(players, players + length);
+        episode.actions.assign(actions, actions + length);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (episodes.size() == capacity)
+        {
+            episodes.pop_front();
+            num_dropped++;
+        }
+        episodes.push_back(std::move(episode));
+    }
+
+    std::vector<Episode> drain(size_t max_episodes = 0)
+    {
+        // NOTE: the oldest max_episodes episodes (all if 0), in the order they finished
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t count = max_episodes == 0 ? episodes.size() : std::min(max_episodes, episodes.size());
+        std::vector<Episode> drained(std::make_move_iterator(episodes.begin()),
+                                     std::make_move_iterator(episodes.begin() + count));
+        episodes.erase(episodes.begin(), episodes.begin() + count);
+        return drained;
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return episodes.size();
+    }
+
+    int64_t numDropped()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return num_dropped;
+    }
+};
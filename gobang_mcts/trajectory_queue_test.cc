@@ -0,0 +1,46 @@
+#include "envpool/gobang_mcts/trajectory_queue.hpp"
+
+#include <gtest/gtest.h>
+
+TEST(TrajectoryQueueTest, AppendDrain)
+{
+    // NOTE: 3 x 3 board with P = 1, one word per plane
+    std::vector<uint64_t> states{1, 2, 3, 4, 5, 6};
+    std::vector<std::pair<int, int>> visits{{0, 9}, {4, 3}, {5, 1}, {2, 7}};
+    std::vector<int> offsets{1, 3, 4}, players{0, 1}, actions{4, 2};
+    TrajectoryQueue queue(2);
+    for (int id = 0; id < 3; ++id)
+        queue.appendGame(id, 3, 1, 2, states.data(), visits.data(), offsets.data(),
+                         players.data(), actions.data(), id % 2);
+    // the oldest episode is dropped
+    EXPECT_EQ(queue.size(), 2);
+    EXPECT_EQ(queue.numDropped(), 1);
+
+    auto episodes = queue.drain(1);
+    ASSERT_EQ(episodes.size(), 1);
+    EXPECT_EQ(episodes[0].id, 1);
+    EXPECT_EQ(episodes[0].winner, 1);
+    EXPECT_EQ(episodes[0].length(), 2);
+    EXPECT_EQ(episodes[0].states, states);
+    // visits are rebased to the first move
+    EXPECT_EQ(episodes[0].visit_offsets, std::vector<int>({0, 2, 3}));
+    EXPECT_EQ(episodes[0].visits[0], std::make_pair(4, 3));
+    EXPECT_EQ(episodes[0].actions, actions);
+
+    episodes = queue.drain();
+    ASSERT_EQ(episodes.size(), 1);
+    EXPECT_EQ(episodes[0].id, 2);
+    EXPECT_EQ(queue.size(), 0);
+    EXPECT_TRUE(queue.drain().empty());
+}
+
+TEST(TrajectoryQueueTest, Shared)
+{
+    // NOTE: one queue per pool, whose capacity is fixed by its first user
+    auto queue = TrajectoryQueue::shared("test", 4);
+    EXPECT_EQ(TrajectoryQueue::shared("test", 4), queue);
+    EXPECT_EQ(TrajectoryQueue::find("test"), queue);
+    EXPECT_NE(TrajectoryQueue::shared("other", 4), queue);
+    EXPECT_THROW(TrajectoryQueue::shared("test", 8), std::runtime_error);
+    EXPECT_EQ(TrajectoryQueue::find("missing"), nullptr);
+}
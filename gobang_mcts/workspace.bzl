@@ -0,0 +1,17 @@
+"""External dependencies of gobang_mcts that envpool does not provide."""
+
+load("@bazel_tools//tools/build_defs/repo:http.bzl", "http_archive")
+load("@bazel_tools//tools/build_defs/repo:utils.bzl", "maybe")
+
+def workspace():
+    """Load the requested dependencies."""
+
+    # NOTE: only used by the *_benchmark targets
+    maybe(
+        http_archive,
+        name = "com_github_google_benchmark",
+        strip_prefix = "benchmark-1.8.3",
+        urls = [
+            "https://github.com/google/benchmark/archive/refs/tags/v1.8.3.tar.gz",
+        ],
+    )
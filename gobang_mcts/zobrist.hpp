@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <random>
+#include <cstdint>
+
+struct Zobrist
+{
+    // NOTE: one random key per (player, cell) of the largest supported board,
+    //  the hash of a position is the xor of the keys of its stones
+    static const int MAX_CELLS = 32 * 32;
+
+    static uint64_t key(int player, int index)
+    {
+        static const auto keys = []()
+        {
+            std::array<uint64_t, 2 * MAX_CELLS> keys;
+            std::mt19937_64 rng(0x9E3779B97F4A7C15ull);
+            for (auto &key : keys)
+                key = rng();
+            return keys;
+        }();
+        return keys[player * MAX_CELLS + index];
+    }
+
+    static uint64_t historyKey(int lag, int index)
+    {
+        // NOTE: key of the move played lag turns before the last one,
+        //  splitmix64 of the stone key instead of another table per lag
+        uint64_t x = key(0, index) + (lag + 1) * 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+};